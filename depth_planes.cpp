@@ -0,0 +1,151 @@
+#include <algorithm>
+
+#include "depth_planes.h"
+#include "surface.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static const int BLOCK_PIXELS = BLOCK_SIZE * BLOCK_SIZE;
+
+DepthPlanes::DepthPlanes(unsigned int width, unsigned int height) :
+        width(width), height(height),
+        blocks_x((width + BLOCK_SIZE - 1) / BLOCK_SIZE), blocks_y((height + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+    blocks.assign(blocks_x * blocks_y, Block{1, {{0, 0, 0}, {0, 0, 0}}, 0});
+}
+
+void DepthPlanes::clear(unsigned short depth) {
+    std::fill(blocks.begin(), blocks.end(), Block{1, {{depth, 0, 0}, {0, 0, 0}}, 0});
+}
+
+void DepthPlanes::clear(const Rect &rect, unsigned short depth) {
+    for (int by = rect.min_y / BLOCK_SIZE; by < (rect.max_y + BLOCK_SIZE - 1) / BLOCK_SIZE; by++) {
+        for (int bx = rect.min_x / BLOCK_SIZE; bx < (rect.max_x + BLOCK_SIZE - 1) / BLOCK_SIZE; bx++) {
+            blocks[by * blocks_x + bx] = Block{1, {{depth, 0, 0}, {0, 0, 0}}, 0};
+        }
+    }
+}
+
+bool DepthPlanes::covers(int x0, int y0, int x1, int y1) const {
+    return (x0 & (BLOCK_SIZE - 1)) == 0 && (y0 & (BLOCK_SIZE - 1)) == 0 &&
+           x1 == std::min(x0 + BLOCK_SIZE, (int) width) && y1 == std::min(y0 + BLOCK_SIZE, (int) height);
+}
+
+unsigned long long DepthPlanes::valid_mask(unsigned int i) const {
+    int w = std::min(BLOCK_SIZE, (int) (width - (i % blocks_x) * BLOCK_SIZE));
+    int h = std::min(BLOCK_SIZE, (int) (height - (i / blocks_x) * BLOCK_SIZE));
+    unsigned long long row = (1ull << w) - 1;
+    unsigned long long mask = 0;
+    for (int j = 0; j < h; j++) mask |= row << (j * BLOCK_SIZE);
+    return mask;
+}
+
+// row j of a plane, and the bits of the pixels of that row of block that match it. Z arithmetic
+// is mod 2^16, which 16 bit lanes do for free.
+#if defined(__SSE2__)
+static_assert(BLOCK_SIZE == 8, "a block row is one register of 16 bit lanes");
+
+static inline __m128i plane_row(const DepthPlane &plane, int j) {
+    __m128i ramp = _mm_mullo_epi16(_mm_set1_epi16(plane.dzdx), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+    return _mm_add_epi16(_mm_set1_epi16((short) (plane.z + plane.dzdy * j)), ramp);
+}
+
+static inline unsigned int match_row(const DepthPlane &plane, int j, const unsigned short *row) {
+    __m128i eq = _mm_cmpeq_epi16(plane_row(plane, j), _mm_loadu_si128(reinterpret_cast<const __m128i *>(row)));
+    return (unsigned int) _mm_movemask_epi8(_mm_packs_epi16(eq, _mm_setzero_si128()));
+}
+#else
+static inline unsigned int match_row(const DepthPlane &plane, int j, const unsigned short *row) {
+    unsigned int bits = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (row[i] == (unsigned short) (plane.z + plane.dzdx * i + plane.dzdy * j)) bits |= 1u << i;
+    }
+    return bits;
+}
+#endif
+
+static unsigned long long match(const DepthPlane &plane, const unsigned short *block) {
+    unsigned long long bits = 0;
+    for (int j = 0; j < BLOCK_SIZE; j++) {
+        bits |= (unsigned long long) match_row(plane, j, block + j * BLOCK_SIZE) << (j * BLOCK_SIZE);
+    }
+    return bits;
+}
+
+void DepthPlanes::expand(unsigned int i, unsigned short *block) const {
+    const Block &b = blocks[i];
+    for (int j = 0; j < BLOCK_SIZE; j++) {
+        unsigned int select = (unsigned int) (b.mask >> (j * BLOCK_SIZE)) & ((1u << BLOCK_SIZE) - 1);
+        unsigned short *row = block + j * BLOCK_SIZE;
+#if defined(__SSE2__)
+        __m128i z = plane_row(b.planes[0], j);
+        if (select) {
+            // spread the select bits over the lanes.
+            __m128i bit = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+            __m128i take = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short) select), bit), bit);
+            z = _mm_or_si128(_mm_andnot_si128(take, z), _mm_and_si128(take, plane_row(b.planes[1], j)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row), z);
+#else
+        for (int k = 0; k < BLOCK_SIZE; k++) {
+            const DepthPlane &plane = b.planes[(select >> k) & 1];
+            row[k] = (unsigned short) (plane.z + plane.dzdx * k + plane.dzdy * j);
+        }
+#endif
+    }
+}
+
+void DepthPlanes::write_block(unsigned int i, const unsigned short *block, unsigned short *db, unsigned int stride,
+                              SurfaceLayout layout) const {
+    int x0 = (int) (i % blocks_x) * BLOCK_SIZE, y0 = (int) (i / blocks_x) * BLOCK_SIZE;
+    int x1 = std::min(x0 + BLOCK_SIZE, (int) width), y1 = std::min(y0 + BLOCK_SIZE, (int) height);
+    for (int y = y0; y < y1; y++) {
+        unsigned short *row = pixel_row(db, layout, stride, x0, y);
+        std::copy(block + (y - y0) * BLOCK_SIZE, block + (y - y0) * BLOCK_SIZE + (x1 - x0), row + x0);
+    }
+}
+
+void DepthPlanes::set(unsigned int i, const DepthPlane &plane) {
+    blocks[i] = Block{1, {plane, {0, 0, 0}}, 0};
+}
+
+void DepthPlanes::store(unsigned int i, const unsigned short *block, const DepthPlane &plane,
+                        unsigned short *db, unsigned int stride, SurfaceLayout layout) {
+    Block &b = blocks[i];
+    unsigned long long valid = valid_mask(i);
+    DepthPlane candidates[3];
+    unsigned long long hits[3];
+    int n = 0;
+    for (int k = 0; k < b.count; k++) candidates[n++] = b.planes[k];
+    candidates[n++] = plane;
+    for (int k = 0; k < n; k++) hits[k] = match(candidates[k], block) & valid;
+
+    for (int k = 0; k < n; k++) {
+        if (hits[k] == valid) {
+            set(i, candidates[k]);
+            return;
+        }
+    }
+    for (int k0 = 0; k0 < n; k0++) {
+        for (int k1 = k0 + 1; k1 < n; k1++) {
+            if ((hits[k0] | hits[k1]) == valid) {
+                b = Block{2, {candidates[k0], candidates[k1]}, valid & ~hits[k0]};
+                return;
+            }
+        }
+    }
+
+    // too complex, back to the depth buffer.
+    b.count = 0;
+    write_block(i, block, db, stride, layout);
+}
+
+void DepthPlanes::decompress(unsigned short *db, unsigned int stride, SurfaceLayout layout) const {
+    alignas(16) unsigned short block[BLOCK_PIXELS];
+    for (unsigned int i = 0; i < blocks_x * blocks_y; i++) {
+        if (!compressed(i)) continue;
+        expand(i, block);
+        write_block(i, block, db, stride, layout);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_DEPTH_PLANES_H
+#define SIMPLE_SOFT_RASTERIZER_DEPTH_PLANES_H
+
+#include <vector>
+
+#include "primitive.h"
+
+// depth over one block: pixel (i, j) of it holds (z + dzdx * i + dzdy * j) & 0xffff, the same
+// wrap the raster loop steps Z with, so a triangle's depth in a block is exactly one plane.
+struct DepthPlane {
+    unsigned short z;
+    short dzdx, dzdy;
+};
+
+// compressed form of a 16 bit depth buffer: every BLOCK_SIZE x BLOCK_SIZE block either holds one
+// or two planes, plus which pixel takes which, or is raw and lives in the depth buffer. the
+// rasterizer keeps it up to date when a RenderTarget carries it, and only touches the depth buffer
+// of raw blocks. decompress() before reading the depth buffer.
+class DepthPlanes {
+public:
+    DepthPlanes(unsigned int width, unsigned int height);
+
+    // every block holds depth.
+    void clear(unsigned short depth);
+
+    // the blocks covering rect, BLOCK_SIZE aligned or ending at the buffer edge, hold depth.
+    void clear(const Rect &rect, unsigned short depth);
+
+    // write the depth of every compressed block into db. the blocks stay compressed.
+    void decompress(unsigned short *db, unsigned int stride, SurfaceLayout layout = SURFACE_LINEAR) const;
+
+    // whether the pixels [x0, x1) x [y0, y1) are all of a block.
+    bool covers(int x0, int y0, int x1, int y1) const;
+
+    // fill block[BLOCK_SIZE * BLOCK_SIZE], row by row, with the depth of compressed block i.
+    void expand(unsigned int i, unsigned short *block) const;
+
+    // block i holds plane only.
+    void set(unsigned int i, const DepthPlane &plane);
+
+    // block i now holds the depth in block, that came from its old planes and plane. keep it as
+    // (at most two of) those or, failing that, write it out to db and make the block raw.
+    void store(unsigned int i, const unsigned short *block, const DepthPlane &plane,
+               unsigned short *db, unsigned int stride, SurfaceLayout layout);
+
+    unsigned int index(int x, int y) const {
+        return (y / BLOCK_SIZE) * blocks_x + (x / BLOCK_SIZE);
+    }
+
+    bool compressed(unsigned int i) const {
+        return blocks[i].count != 0;
+    }
+
+private:
+    struct Block {
+        // planes in use, 0 for raw.
+        unsigned char count;
+        DepthPlane planes[2];
+        // bit j * BLOCK_SIZE + i set where pixel (i, j) takes planes[1].
+        unsigned long long mask;
+    };
+
+    // bits of the pixels of block i inside the buffer.
+    unsigned long long valid_mask(unsigned int i) const;
+
+    // copy the pixels of block i inside the buffer from block to db.
+    void write_block(unsigned int i, const unsigned short *block, unsigned short *db, unsigned int stride,
+                     SurfaceLayout layout) const;
+
+    std::vector<Block> blocks;
+    unsigned int width, height;
+    unsigned int blocks_x, blocks_y;
+};
+
+#endif //SIMPLE_SOFT_RASTERIZER_DEPTH_PLANES_H
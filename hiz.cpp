@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "hiz.h"
+#include "surface.h"
+
+HiZBuffer::HiZBuffer(unsigned int width, unsigned int height) :
+        width(width), height(height),
+        blocks_x((width + BLOCK_SIZE - 1) / BLOCK_SIZE), blocks_y((height + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+    zmin.assign(blocks_x * blocks_y, 0);
+    zmax.assign(blocks_x * blocks_y, 0);
+}
+
+void HiZBuffer::clear(unsigned short depth) {
+    std::fill(zmin.begin(), zmin.end(), depth);
+    std::fill(zmax.begin(), zmax.end(), depth);
+}
+
+void HiZBuffer::clear(const Rect &rect, unsigned short depth) {
+    for (int by = rect.min_y / BLOCK_SIZE; by < (rect.max_y + BLOCK_SIZE - 1) / BLOCK_SIZE; by++) {
+        for (int bx = rect.min_x / BLOCK_SIZE; bx < (rect.max_x + BLOCK_SIZE - 1) / BLOCK_SIZE; bx++) {
+            zmin[by * blocks_x + bx] = zmax[by * blocks_x + bx] = depth;
+        }
+    }
+}
+
+void HiZBuffer::rebuild(const unsigned short *db, unsigned int stride, SurfaceLayout layout) {
+    for (unsigned int by = 0; by < blocks_y; by++) {
+        for (unsigned int bx = 0; bx < blocks_x; bx++) {
+            update((int) bx * BLOCK_SIZE, (int) by * BLOCK_SIZE, db, stride, layout);
+        }
+    }
+}
+
+void HiZBuffer::update(int x, int y, const unsigned short *db, unsigned int stride, SurfaceLayout layout) {
+    int x0 = x & ~(BLOCK_SIZE - 1), y0 = y & ~(BLOCK_SIZE - 1);
+    int x1 = std::min(x0 + BLOCK_SIZE, (int) width), y1 = std::min(y0 + BLOCK_SIZE, (int) height);
+    unsigned short lo = 0xffff, hi = 0;
+    for (int iy = y0; iy < y1; iy++) {
+        const unsigned short *row = pixel_row(db, layout, stride, x0, iy);
+        for (int ix = x0; ix < x1; ix++) {
+            lo = std::min(lo, row[ix]);
+            hi = std::max(hi, row[ix]);
+        }
+    }
+    unsigned int i = index(x, y);
+    zmin[i] = lo;
+    zmax[i] = hi;
+}
+
+void HiZBuffer::update(int x, int y, const unsigned short *block) {
+    int x0 = x & ~(BLOCK_SIZE - 1), y0 = y & ~(BLOCK_SIZE - 1);
+    int w = std::min(BLOCK_SIZE, (int) width - x0), h = std::min(BLOCK_SIZE, (int) height - y0);
+    unsigned short lo = 0xffff, hi = 0;
+    for (int iy = 0; iy < h; iy++) {
+        for (int ix = 0; ix < w; ix++) {
+            lo = std::min(lo, block[iy * BLOCK_SIZE + ix]);
+            hi = std::max(hi, block[iy * BLOCK_SIZE + ix]);
+        }
+    }
+    unsigned int i = index(x, y);
+    zmin[i] = lo;
+    zmax[i] = hi;
+}
@@ -0,0 +1,43 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_HIZ_H
+#define SIMPLE_SOFT_RASTERIZER_HIZ_H
+
+#include <vector>
+
+#include "primitive.h"
+
+// min / max summary of every BLOCK_SIZE x BLOCK_SIZE block of a 16 bit depth buffer, so the
+// rasterizer can reject (or skip the depth test of) a whole block without reading it.
+// the rasterizer rescans every block it writes, anyone else writing the depth buffer
+// has to call clear() or rebuild().
+class HiZBuffer {
+public:
+    HiZBuffer(unsigned int width, unsigned int height);
+
+    // the depth buffer was filled with depth.
+    void clear(unsigned short depth);
+
+    // the pixels of rect, BLOCK_SIZE aligned or ending at the buffer edge, were filled with depth.
+    void clear(const Rect &rect, unsigned short depth);
+
+    // the depth buffer was written behind our back, rescan all of it.
+    void rebuild(const unsigned short *db, unsigned int stride, SurfaceLayout layout = SURFACE_LINEAR);
+
+    // rescan the block holding pixel (x, y).
+    void update(int x, int y, const unsigned short *db, unsigned int stride,
+                SurfaceLayout layout = SURFACE_LINEAR);
+
+    // same, from the BLOCK_SIZE x BLOCK_SIZE pixels of that block, row by row.
+    void update(int x, int y, const unsigned short *block);
+
+    unsigned int index(int x, int y) const {
+        return (y / BLOCK_SIZE) * blocks_x + (x / BLOCK_SIZE);
+    }
+
+    std::vector<unsigned short> zmin, zmax;
+
+private:
+    unsigned int width, height;
+    unsigned int blocks_x, blocks_y;
+};
+
+#endif //SIMPLE_SOFT_RASTERIZER_HIZ_H
@@ -3,10 +3,11 @@
 #define SDL_MAIN_HANDLED
 
 #include <SDL.h>
-#include "vertex.h"
-
-void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const char *tex,
-                           unsigned short *db, unsigned int *fb);
+#include "tile_renderer.h"
+#include "depth_planes.h"
+#include "hiz.h"
+#include "texture.h"
+#include "surface.h"
 
 const int WIDTH = 800, HEIGHT = 600; // SDL窗口的宽和高
 
@@ -33,8 +34,28 @@ int main() {
     SDL_Texture *tex = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, WIDTH, HEIGHT);
     SDL_Event windowEvent; // SDL窗口事件
 
-    char *fb = static_cast<char *>(malloc((WIDTH + 10) * HEIGHT * 4));
-    char *db = static_cast<char *>(malloc((WIDTH + 10) * HEIGHT * 2));
+    // fb / db are tiled, present is what goes to the screen.
+    char *fb = static_cast<char *>(malloc(surface_size(WIDTH, HEIGHT, SURFACE_TILED) * 4));
+    char *db = static_cast<char *>(malloc(surface_size(WIDTH, HEIGHT, SURFACE_TILED) * 2));
+    auto *present = static_cast<unsigned int *>(malloc(WIDTH * HEIGHT * 4));
+
+    TileRenderer renderer(WIDTH, HEIGHT);
+    renderer.set_setup(triangle_setup<12, 4>, setup_range<12, 4>());
+    renderer.set_layout(SURFACE_TILED);
+    HiZBuffer hiz(WIDTH, HEIGHT);
+    DepthPlanes planes(WIDTH, HEIGHT);
+    renderer.set_depth_planes(&planes);
+
+    // 8x8 texel checker board
+    unsigned int checker[64 * 64];
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            checker[y * 64 + x] = ((x >> 3) ^ (y >> 3)) & 1 ? 0xffe0e0e0 : 0xff303030;
+        }
+    }
+    Texture texture(64, 64, TEX_ARGB8888, checker, 0, LAYOUT_TILED);
+    texture.generate_mipmaps();
+    texture.set_sampler(FILTER_BILINEAR, ADDRESS_WRAP, MIP_LINEAR);
 
     int _i = 0;
     while (true) {
@@ -45,19 +66,20 @@ int main() {
                 break;
             }
         }
-        memset(fb, 0x55, WIDTH * HEIGHT * 4);
-        memset(db, 0x0, WIDTH * HEIGHT * 2);
+        renderer.clear(0x55555555, 0);
         Vertex in1[3] = {{{200.f, 100.f, 1.0f, 1.f}, {0.45f, 0.45f}},
                          {{600.f, 100.f, 0.8f, 1.f}, {1.f,   0.f}},
                          {{200.f, 500.f, 0.8f, 1.f}, {0.f,   1.f}}};
         Vertex in2[3] = {{{400.f, 100.f, 0.8f,                     1.f}, {0.99f, 0.99f}},
                          {{400.f, 300.f, 1.0f - ((float) i / 2500), 1.f}, {0.99f, 0.99f}},
                          {{200.f, 300.f, 0.8f,                     1.f}, {0.99f, 0.99f}}};
-        half_space_rasterizer(in1, WIDTH, HEIGHT, nullptr, reinterpret_cast<unsigned short *>(db),
-                              reinterpret_cast<unsigned int *>(fb));
-        half_space_rasterizer(in2, WIDTH, HEIGHT, nullptr, reinterpret_cast<unsigned short *>(db),
-                              reinterpret_cast<unsigned int *>(fb));
-        SDL_UpdateTexture(tex, nullptr, fb, WIDTH * 4);
+        renderer.draw(in1);
+        renderer.draw(in2);
+        renderer.flush(&texture, reinterpret_cast<unsigned short *>(db), reinterpret_cast<unsigned int *>(fb), &hiz);
+        renderer.resolve(reinterpret_cast<unsigned short *>(db), reinterpret_cast<unsigned int *>(fb), &hiz);
+        surface_resolve(reinterpret_cast<unsigned int *>(fb), SURFACE_TILED, surface_stride(WIDTH, SURFACE_TILED),
+                        WIDTH, HEIGHT, present);
+        SDL_UpdateTexture(tex, nullptr, present, WIDTH * 4);
         SDL_RenderCopy(render, tex, nullptr, nullptr);
         SDL_RenderPresent(render);
         _i++;
@@ -65,6 +87,8 @@ int main() {
     }
 
     free(fb);
+    free(db);
+    free(present);
     SDL_DestroyWindow(window); // 销毁SDL窗体
     SDL_Quit(); // SDL退出
     return 0;
@@ -5,4 +5,104 @@
 #ifndef SIMPLE_SOFT_RASTERIZER_PRIMITIVE_H
 #define SIMPLE_SOFT_RASTERIZER_PRIMITIVE_H
 
+// edge of the square blocks the coarse raster pass works on, a power of two.
+static const int BLOCK_SIZE = 8;
+
+class HiZBuffer;
+
+class DepthPlanes;
+
+// screen space rectangle, [min, max).
+struct Rect {
+    int min_x, min_y, max_x, max_y;
+};
+
+static inline Rect rect_intersect(const Rect &a, const Rect &b) {
+    return Rect{a.min_x > b.min_x ? a.min_x : b.min_x, a.min_y > b.min_y ? a.min_y : b.min_y,
+                a.max_x < b.max_x ? a.max_x : b.max_x, a.max_y < b.max_y ? a.max_y : b.max_y};
+}
+
+// how a color / depth / id buffer stores its pixels. tiled keeps every BLOCK_SIZE x BLOCK_SIZE
+// block in consecutive pixels, so a block the raster loop works on touches as few cache lines
+// and pages as possible. see surface.h.
+enum SurfaceLayout {
+    SURFACE_LINEAR, SURFACE_TILED
+};
+
+// color / depth buffer pair the rasterizer writes into.
+struct RenderTarget {
+    unsigned int *fb;
+    unsigned short *db;
+    // pixels between rows, a multiple of BLOCK_SIZE when tiled.
+    unsigned int stride;
+    // optional, kept in sync with db when present.
+    HiZBuffer *hiz;
+    SurfaceLayout layout = SURFACE_LINEAR;
+    // optional, db only holds the blocks it keeps raw when present.
+    DepthPlanes *planes = nullptr;
+};
+
+enum DepthFunc {
+    DEPTH_NEVER, DEPTH_LESS, DEPTH_EQUAL, DEPTH_LEQUAL, DEPTH_GREATER, DEPTH_NOTEQUAL, DEPTH_GEQUAL, DEPTH_ALWAYS
+};
+
+enum BlendMode {
+    // dst = src
+    BLEND_NONE,
+    // dst = min(src + dst, 255), per channel
+    BLEND_ADD,
+    // dst = src * src.a + dst * (1 - src.a), per channel
+    BLEND_ALPHA
+};
+
+// which side of a triangle is culled.
+enum CullMode {
+    CULL_NONE, CULL_FRONT, CULL_BACK
+};
+
+// the winding of front facing triangles on screen, x right and y up as in NDC.
+enum FrontFace {
+    FRONT_CCW, FRONT_CW
+};
+
+// per draw pipeline state. depth is "nearer" when larger, the buffer being cleared to 0.
+struct RasterState {
+    bool depth_test = true;
+    DepthFunc depth_func = DEPTH_GEQUAL;
+    // ignored without depth_test.
+    bool depth_write = true;
+    bool color_write = true;
+    BlendMode blend = BLEND_NONE;
+    CullMode cull = CULL_BACK;
+    FrontFace front_face = FRONT_CCW;
+};
+
+// per-triangle fixed-point setup, produced once and consumed by any number of raster calls.
+struct TriangleSetup {
+    // bounding box, [min, max).
+    short min_x, min_y, max_x, max_y;
+    // vertex 0, the origin of the attribute planes.
+    short x0, y0;
+    // depth there, only ever outside 16 bits with depth_clip or depth_clamp.
+    int d0;
+    unsigned short u0, v0;
+    // edge functions at pixel (0, 0) and their per pixel steps. the 12.0 ones live in a
+    // 24 bit ring where only bit 23 is meaningful (edge_bits == 24), the sub-pixel ones are
+    // exact and already include the fill rule (edge_bits == 64).
+    long long F01_0, F12_0, F20_0;
+    int DF01DX, DF12DX, DF20DX, DF01DY, DF12DY, DF20DY;
+    int edge_bits;
+    // attribute steps. depth is stepped in 32 bits, a sliver's can be steeper than 16; U / V are
+    // already sign-extended from 12 bits.
+    int DZDX, DZDY;
+    short DUDX, DUDY, DVDX, DVDY;
+    // the triangle is not clipped to the near / far planes, its pixels whose depth plane lies
+    // outside [0, 0xffff] are cut instead.
+    bool depth_clip;
+    // the depth plane leaves [0, 0xffff] somewhere in the box only by the rounding of its
+    // gradients, e.g. next to a vertex on the near or far plane. its pixels past either end take
+    // that end instead.
+    bool depth_clamp;
+};
+
 #endif //SIMPLE_SOFT_RASTERIZER_PRIMITIVE_H
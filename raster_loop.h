@@ -0,0 +1,802 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_RASTER_LOOP_H
+#define SIMPLE_SOFT_RASTERIZER_RASTER_LOOP_H
+
+// the raster loops, as templates over the pipeline state and the fragment shader. include this
+// to compile them for a shader of your own, see shader.h and fragment_program() at the end.
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include "depth_planes.h"
+#include "hiz.h"
+#include "rasterizer.h"
+#include "shader.h"
+#include "surface.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// interpolants at one pixel of a walk. the attributes are linear in (x, y) modulo their width,
+// so a walk can start at any pixel. the edge functions are block local, see classify_block.
+struct Interpolants {
+    int F01, F12, F20;
+    int Z, U, V;
+};
+
+inline void attributes_at(Interpolants &p, const TriangleSetup &setup, int x, int y) {
+    p.Z = (setup.d0 + setup.DZDX * (x - setup.x0) + setup.DZDY * (y - setup.y0)) & 0xffff;
+    p.U = (setup.u0 + setup.DUDX * (x - setup.x0) + setup.DUDY * (y - setup.y0)) & 0xfff;
+    p.V = (setup.v0 + setup.DVDX * (x - setup.x0) + setup.DVDY * (y - setup.y0)) & 0xfff;
+}
+
+// the bit of a block local edge value that marks a pixel outside.
+inline int edge_sign(const TriangleSetup &setup) {
+    return setup.edge_bits == 24 ? 0x800000 : (int) 0x80000000;
+}
+
+inline void step_x(Interpolants &p, const TriangleSetup &setup, int n) {
+    p.F01 += setup.DF01DX * n;
+    p.F12 += setup.DF12DX * n;
+    p.F20 += setup.DF20DX * n;
+    p.Z = (p.Z + setup.DZDX * n) & 0xffff;
+    p.U = (p.U + setup.DUDX * n) & 0xfff;
+    p.V = (p.V + setup.DVDX * n) & 0xfff;
+}
+
+inline void step_y(Interpolants &p, const TriangleSetup &setup) {
+    p.F01 += setup.DF01DY;
+    p.F12 += setup.DF12DY;
+    p.F20 += setup.DF20DY;
+    p.Z = (p.Z + setup.DZDY) & 0xffff;
+    p.U = (p.U + setup.DUDY) & 0xfff;
+    p.V = (p.V + setup.DVDY) & 0xfff;
+}
+
+// compile-time twin of RasterState, every permutation gets its own raster loop.
+template<DepthFunc DEPTH_FUNC, bool DEPTH_WRITE, bool COLOR_WRITE, BlendMode BLEND>
+struct StaticRasterState {
+    static constexpr DepthFunc depth_func = DEPTH_FUNC;
+    static constexpr bool depth_write = DEPTH_WRITE;
+    static constexpr bool color_write = COLOR_WRITE;
+    static constexpr BlendMode blend = BLEND;
+};
+
+template<DepthFunc F>
+inline bool depth_pass(int z, int d) {
+    switch (F) {
+        case DEPTH_NEVER:
+            return false;
+        case DEPTH_LESS:
+            return z < d;
+        case DEPTH_EQUAL:
+            return z == d;
+        case DEPTH_LEQUAL:
+            return z <= d;
+        case DEPTH_GREATER:
+            return z > d;
+        case DEPTH_NOTEQUAL:
+            return z != d;
+        case DEPTH_GEQUAL:
+            return z >= d;
+        default:
+            return true;
+    }
+}
+
+// x / 255 rounded, exact for x in [0, 255 * 255].
+inline unsigned int div255(unsigned int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+template<BlendMode B>
+inline unsigned int blend(unsigned int src, unsigned int dst) {
+    if (B == BLEND_NONE) return src;
+    unsigned int out = 0, a = src >> 24;
+    for (int i = 0; i < 32; i += 8) {
+        unsigned int s = (src >> i) & 0xff, d = (dst >> i) & 0xff;
+        unsigned int c = B == BLEND_ADD ? std::min(s + d, 0xffu) : div255(s * a + d * (255 - a));
+        out |= c << i;
+    }
+    return out;
+}
+
+#if defined(__AVX2__)
+
+template<DepthFunc F>
+inline __m256i depth_pass(__m256i Z, __m256i D) {
+    // both sides fit in 16 bits, so the signed compares are unsigned ones.
+    const __m256i ones = _mm256_set1_epi32(-1);
+    switch (F) {
+        case DEPTH_NEVER:
+            return _mm256_setzero_si256();
+        case DEPTH_LESS:
+            return _mm256_cmpgt_epi32(D, Z);
+        case DEPTH_EQUAL:
+            return _mm256_cmpeq_epi32(Z, D);
+        case DEPTH_LEQUAL:
+            return _mm256_xor_si256(_mm256_cmpgt_epi32(Z, D), ones);
+        case DEPTH_GREATER:
+            return _mm256_cmpgt_epi32(Z, D);
+        case DEPTH_NOTEQUAL:
+            return _mm256_xor_si256(_mm256_cmpeq_epi32(Z, D), ones);
+        case DEPTH_GEQUAL:
+            return _mm256_xor_si256(_mm256_cmpgt_epi32(D, Z), ones);
+        default:
+            return ones;
+    }
+}
+
+// 8 bit channels, same rounding as the scalar blend.
+template<BlendMode B>
+inline __m256i blend(__m256i src, __m256i dst) {
+    if (B == BLEND_NONE) return src;
+    if (B == BLEND_ADD) return _mm256_adds_epu8(src, dst);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255), round = _mm256_set1_epi16(128);
+    auto half = [&](__m256i s, __m256i d) {
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+        __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(full, a)));
+        x = _mm256_add_epi16(x, round);
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    };
+    __m256i lo = half(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(dst, zero));
+    __m256i hi = half(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(dst, zero));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// std::true_type when Shader has a shade() for Fragment8.
+template<class Shader>
+auto has_shade8(int) -> decltype(std::declval<const Shader &>().shade(std::declval<const Fragment8 &>(),
+                                                                      *static_cast<__m256i *>(nullptr)),
+        std::true_type{});
+
+template<class Shader>
+std::false_type has_shade8(...);
+
+// 8 pixels through the shader, one at a time when it has no 8 wide shade().
+template<class Shader>
+inline __m256i shade_lanes(const Shader &shader, const Fragment8 &in, __m256i &color) {
+    if constexpr (decltype(has_shade8<Shader>(0))::value) {
+        return shader.shade(in, color);
+    } else {
+        alignas(32) int z[8], u[8], v[8], keep[8];
+        alignas(32) unsigned int c[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(z), in.z);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(u), in.u);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(v), in.v);
+        for (int i = 0; i < 8; i++) keep[i] = shader.shade(Fragment{in.x + i, in.y, z[i], u[i], v[i]}, c[i]) ? -1 : 0;
+        color = _mm256_load_si256(reinterpret_cast<const __m256i *>(c));
+        return _mm256_load_si256(reinterpret_cast<const __m256i *>(keep));
+    }
+}
+
+// the lanes of the 8 pixels from (ix, y) on inside the triangle, p holding the interpolants at ix.
+inline __m256i covered_avx2(const TriangleSetup &setup, const Interpolants &p) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i F01 = _mm256_add_epi32(_mm256_set1_epi32(p.F01), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DF01DX)));
+    __m256i F12 = _mm256_add_epi32(_mm256_set1_epi32(p.F12), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DF12DX)));
+    __m256i F20 = _mm256_add_epi32(_mm256_set1_epi32(p.F20), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DF20DX)));
+    __m256i outside = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(F01, F12), F20),
+                                       _mm256_set1_epi32(edge_sign(setup)));
+    return _mm256_cmpeq_epi32(outside, _mm256_setzero_si256());
+}
+
+// 8 pixels [ix, ix + 8) of row y at once, lane i holds pixel ix + i, the ones in covered are
+// written. without partial every lane is covered, without depth_test every pixel is known to
+// pass. return whether the depth buffer was written.
+template<class State, bool partial, bool depth_test, class Shader>
+inline bool raster_lanes_avx2(const TriangleSetup &setup, const Interpolants &p, __m256i covered, int ix, int y,
+                              const Shader &shader, unsigned int *fb, unsigned short *db) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i Z = _mm256_add_epi32(_mm256_set1_epi32(p.Z), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DZDX)));
+    Z = _mm256_and_si256(Z, _mm256_set1_epi32(0xffff));
+    __m256i D = Z;
+    __m256i write = covered;
+    if (depth_test || (State::depth_write && (partial || Shader::discards))) {
+        D = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(db)));
+    }
+    if (depth_test) {
+        write = _mm256_and_si256(write, depth_pass<State::depth_func>(Z, D));
+        if (_mm256_testz_si256(write, write)) return false;
+    }
+
+    __m256i color = _mm256_setzero_si256();
+    if (State::color_write || Shader::discards) {
+        __m256i U = _mm256_add_epi32(_mm256_set1_epi32(p.U), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DUDX)));
+        __m256i V = _mm256_add_epi32(_mm256_set1_epi32(p.V), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DVDX)));
+        Fragment8 in{ix, y, Z, _mm256_and_si256(U, _mm256_set1_epi32(0xfff)), _mm256_and_si256(V, _mm256_set1_epi32(0xfff))};
+        __m256i keep = shade_lanes(shader, in, color);
+        if (Shader::discards) {
+            write = _mm256_and_si256(write, keep);
+            if (_mm256_testz_si256(write, write)) return false;
+        }
+    }
+
+    if (State::color_write) {
+        if (State::blend != BLEND_NONE) {
+            color = blend<State::blend>(color, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fb)));
+        }
+        _mm256_maskstore_epi32(reinterpret_cast<int *>(fb), write, color);
+    }
+
+    if (!State::depth_write) return false;
+    D = _mm256_blendv_epi8(D, Z, write);
+    D = _mm256_permute4x64_epi64(_mm256_packus_epi32(D, D), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(db), _mm256_castsi256_si128(D));
+    return true;
+}
+
+// raster_lanes_avx2() of the lanes inside the triangle, or all of them without edge_test.
+template<class State, bool edge_test, bool depth_test, class Shader>
+inline bool raster_avx2(const TriangleSetup &setup, const Interpolants &p, int ix, int y, const Shader &shader,
+                        unsigned int *fb, unsigned short *db) {
+    __m256i covered = _mm256_set1_epi32(-1);
+    if (edge_test) {
+        covered = covered_avx2(setup, p);
+        if (_mm256_testz_si256(covered, covered)) return false;
+    }
+    return raster_lanes_avx2<State, edge_test, depth_test>(setup, p, covered, ix, y, shader, fb, db);
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+template<DepthFunc F>
+inline __m128i depth_pass(__m128i Z, __m128i D) {
+    // both sides fit in 16 bits, so the signed compares are unsigned ones.
+    const __m128i ones = _mm_set1_epi32(-1);
+    switch (F) {
+        case DEPTH_NEVER:
+            return _mm_setzero_si128();
+        case DEPTH_LESS:
+            return _mm_cmpgt_epi32(D, Z);
+        case DEPTH_EQUAL:
+            return _mm_cmpeq_epi32(Z, D);
+        case DEPTH_LEQUAL:
+            return _mm_xor_si128(_mm_cmpgt_epi32(Z, D), ones);
+        case DEPTH_GREATER:
+            return _mm_cmpgt_epi32(Z, D);
+        case DEPTH_NOTEQUAL:
+            return _mm_xor_si128(_mm_cmpeq_epi32(Z, D), ones);
+        case DEPTH_GEQUAL:
+            return _mm_xor_si128(_mm_cmpgt_epi32(D, Z), ones);
+        default:
+            return ones;
+    }
+}
+
+// 8 bit channels, same rounding as the scalar blend.
+template<BlendMode B>
+inline __m128i blend(__m128i src, __m128i dst) {
+    if (B == BLEND_NONE) return src;
+    if (B == BLEND_ADD) return _mm_adds_epu8(src, dst);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255), round = _mm_set1_epi16(128);
+    auto half = [&](__m128i s, __m128i d) {
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+        __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(full, a)));
+        x = _mm_add_epi16(x, round);
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    };
+    __m128i lo = half(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+    __m128i hi = half(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+    return _mm_packus_epi16(lo, hi);
+}
+
+template<class Shader>
+auto has_shade4(int) -> decltype(std::declval<const Shader &>().shade(std::declval<const Fragment4 &>(),
+                                                                      *static_cast<__m128i *>(nullptr)),
+        std::true_type{});
+
+template<class Shader>
+std::false_type has_shade4(...);
+
+template<class Shader>
+inline __m128i shade_lanes(const Shader &shader, const Fragment4 &in, __m128i &color) {
+    if constexpr (decltype(has_shade4<Shader>(0))::value) {
+        return shader.shade(in, color);
+    } else {
+        alignas(16) int z[4], u[4], v[4], keep[4];
+        alignas(16) unsigned int c[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(z), in.z);
+        _mm_store_si128(reinterpret_cast<__m128i *>(u), in.u);
+        _mm_store_si128(reinterpret_cast<__m128i *>(v), in.v);
+        for (int i = 0; i < 4; i++) keep[i] = shader.shade(Fragment{in.x + i, in.y, z[i], u[i], v[i]}, c[i]) ? -1 : 0;
+        color = _mm_load_si128(reinterpret_cast<const __m128i *>(c));
+        return _mm_load_si128(reinterpret_cast<const __m128i *>(keep));
+    }
+}
+
+// the lanes of the 4 pixels from (ix, y) on inside the triangle, see covered_avx2.
+inline __m128i covered_sse2(const TriangleSetup &setup, const Interpolants &p) {
+    __m128i F01 = _mm_setr_epi32(p.F01, p.F01 + setup.DF01DX, p.F01 + setup.DF01DX * 2, p.F01 + setup.DF01DX * 3);
+    __m128i F12 = _mm_setr_epi32(p.F12, p.F12 + setup.DF12DX, p.F12 + setup.DF12DX * 2, p.F12 + setup.DF12DX * 3);
+    __m128i F20 = _mm_setr_epi32(p.F20, p.F20 + setup.DF20DX, p.F20 + setup.DF20DX * 2, p.F20 + setup.DF20DX * 3);
+    __m128i outside = _mm_and_si128(_mm_or_si128(_mm_or_si128(F01, F12), F20), _mm_set1_epi32(edge_sign(setup)));
+    return _mm_cmpeq_epi32(outside, _mm_setzero_si128());
+}
+
+// 4 pixels [ix, ix + 4) of row y at once, lane i holds pixel ix + i. see raster_lanes_avx2.
+template<class State, bool partial, bool depth_test, class Shader>
+inline bool raster_lanes_sse2(const TriangleSetup &setup, const Interpolants &p, __m128i covered, int ix, int y,
+                              const Shader &shader, unsigned int *fb, unsigned short *db) {
+    __m128i Z = _mm_setr_epi32(p.Z, p.Z + setup.DZDX, p.Z + setup.DZDX * 2, p.Z + setup.DZDX * 3);
+    Z = _mm_and_si128(Z, _mm_set1_epi32(0xffff));
+    __m128i D = Z;
+    __m128i write = covered;
+    if (depth_test || (State::depth_write && (partial || Shader::discards))) {
+        D = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(db)), _mm_setzero_si128());
+    }
+    if (depth_test) {
+        write = _mm_and_si128(write, depth_pass<State::depth_func>(Z, D));
+        if (_mm_movemask_epi8(write) == 0) return false;
+    }
+
+    __m128i color = _mm_setzero_si128();
+    if (State::color_write || Shader::discards) {
+        __m128i U = _mm_setr_epi32(p.U, p.U + setup.DUDX, p.U + setup.DUDX * 2, p.U + setup.DUDX * 3);
+        __m128i V = _mm_setr_epi32(p.V, p.V + setup.DVDX, p.V + setup.DVDX * 2, p.V + setup.DVDX * 3);
+        Fragment4 in{ix, y, Z, _mm_and_si128(U, _mm_set1_epi32(0xfff)), _mm_and_si128(V, _mm_set1_epi32(0xfff))};
+        __m128i keep = shade_lanes(shader, in, color);
+        if (Shader::discards) {
+            write = _mm_and_si128(write, keep);
+            if (_mm_movemask_epi8(write) == 0) return false;
+        }
+    }
+
+    if (State::color_write) {
+        __m128i C = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fb));
+        color = blend<State::blend>(color, C);
+        C = _mm_or_si128(_mm_and_si128(write, color), _mm_andnot_si128(write, C));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(fb), C);
+    }
+
+    if (!State::depth_write) return false;
+    D = _mm_or_si128(_mm_and_si128(write, Z), _mm_andnot_si128(write, D));
+    // no unsigned 32 -> 16 pack in SSE2, sign-extend the low halves and use the signed one.
+    D = _mm_srai_epi32(_mm_slli_epi32(D, 16), 16);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(db), _mm_packs_epi32(D, D));
+    return true;
+}
+
+// raster_lanes_sse2() of the lanes inside the triangle, or all of them without edge_test.
+template<class State, bool edge_test, bool depth_test, class Shader>
+inline bool raster_sse2(const TriangleSetup &setup, const Interpolants &p, int ix, int y, const Shader &shader,
+                        unsigned int *fb, unsigned short *db) {
+    __m128i covered = _mm_set1_epi32(-1);
+    if (edge_test) {
+        covered = covered_sse2(setup, p);
+        if (_mm_movemask_epi8(covered) == 0) return false;
+    }
+    return raster_lanes_sse2<State, edge_test, depth_test>(setup, p, covered, ix, y, shader, fb, db);
+}
+
+#endif
+
+// one row [ix, max_x) of row y, p holds the interpolants at ix. see raster_avx2.
+template<class State, bool edge_test, bool depth_test, class Shader>
+inline bool raster_span(const TriangleSetup &setup, Interpolants p, int ix, int max_x, int y,
+                        const Shader &shader, unsigned int *fb, unsigned short *db) {
+    bool wrote = false;
+    int sign = edge_sign(setup);
+#if defined(__AVX2__)
+    for (; ix + 8 <= max_x; ix += 8) {
+        wrote |= raster_avx2<State, edge_test, depth_test>(setup, p, ix, y, shader, fb + ix, db + ix);
+        step_x(p, setup, 8);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; ix + 4 <= max_x; ix += 4) {
+        wrote |= raster_sse2<State, edge_test, depth_test>(setup, p, ix, y, shader, fb + ix, db + ix);
+        step_x(p, setup, 4);
+    }
+#endif
+    for (; ix < max_x; ix += (1)) {
+        if (!edge_test || ((p.F01 | p.F12 | p.F20) & sign) == 0) {
+            unsigned int color = 0;
+            if ((!depth_test || depth_pass<State::depth_func>(p.Z, db[ix])) &&
+                (!(State::color_write || Shader::discards) || shader.shade(Fragment{ix, y, p.Z, p.U, p.V}, color))) {
+                if (State::color_write) fb[ix] = blend<State::blend>(color, fb[ix]);
+                if (State::depth_write) db[ix] = (unsigned short) p.Z;
+                wrote |= State::depth_write;
+            }
+        }
+        step_x(p, setup, 1);
+    }
+    return wrote;
+}
+
+template<class State, bool edge_test, class Shader>
+inline bool raster_span(const TriangleSetup &setup, const Interpolants &p, int ix, int max_x, int y,
+                        const Shader &shader, unsigned int *fb, unsigned short *db, bool depth_test) {
+    if (depth_test) return raster_span<State, edge_test, true>(setup, p, ix, max_x, y, shader, fb, db);
+    return raster_span<State, edge_test, false>(setup, p, ix, max_x, y, shader, fb, db);
+}
+
+// a triangle whose box lies in one block is drawn as a stamp: the block, BLOCK_SIZE pixels of a
+// row at once however narrow the box, with the coverage of all of its rows worked out up front
+// as one bit per pixel, bit j * BLOCK_SIZE + i for pixel (i, j).
+static_assert(BLOCK_SIZE == 8, "a stamp row is one byte of coverage");
+
+// the coverage of rows [0, h) of the stamp whose interpolants at its top left pixel are p.
+inline unsigned long long stamp_coverage(const TriangleSetup &setup, Interpolants p, int h) {
+    unsigned long long bits = 0;
+    for (int j = 0; j < h; j++, step_y(p, setup)) {
+#if defined(__AVX2__)
+        auto row = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(covered_avx2(setup, p)));
+#elif defined(__SSE2__)
+        Interpolants q = p;
+        step_x(q, setup, 4);
+        auto row = (unsigned int) (_mm_movemask_ps(_mm_castsi128_ps(covered_sse2(setup, p))) |
+                                   _mm_movemask_ps(_mm_castsi128_ps(covered_sse2(setup, q))) << 4);
+#else
+        unsigned int row = 0;
+        Interpolants q = p;
+        for (int i = 0; i < BLOCK_SIZE; i++, step_x(q, setup, 1)) {
+            if (((q.F01 | q.F12 | q.F20) & edge_sign(setup)) == 0) row |= 1u << i;
+        }
+#endif
+        bits |= (unsigned long long) row << (j * BLOCK_SIZE);
+    }
+    return bits;
+}
+
+// the pixels of row y of a stamp at x whose bits are set, p holding the interpolants at x.
+template<class State, class Shader>
+inline bool raster_stamp_row(const TriangleSetup &setup, Interpolants p, unsigned int bits, int x, int y,
+                             const Shader &shader, unsigned int *fb, unsigned short *db, bool depth_test) {
+#if defined(__AVX2__)
+    const __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i covered = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int) bits), bit), bit);
+    if (depth_test) return raster_lanes_avx2<State, true, true>(setup, p, covered, x, y, shader, fb + x, db + x);
+    return raster_lanes_avx2<State, true, false>(setup, p, covered, x, y, shader, fb + x, db + x);
+#elif defined(__SSE2__)
+    const __m128i bit = _mm_setr_epi32(1, 2, 4, 8);
+    bool wrote = false;
+    for (int i = 0; i < BLOCK_SIZE; i += 4, step_x(p, setup, 4)) {
+        unsigned int half = (bits >> i) & 0xf;
+        if (half == 0) continue;
+        __m128i covered = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int) half), bit), bit);
+        if (depth_test) {
+            wrote |= raster_lanes_sse2<State, true, true>(setup, p, covered, x + i, y, shader, fb + x + i, db + x + i);
+        } else {
+            wrote |= raster_lanes_sse2<State, true, false>(setup, p, covered, x + i, y, shader, fb + x + i, db + x + i);
+        }
+    }
+    return wrote;
+#else
+    bool wrote = false;
+    for (int i = 0; i < BLOCK_SIZE; i++, step_x(p, setup, 1)) {
+        if ((bits >> i) & 1) wrote |= raster_span<State, false>(setup, p, x + i, x + i + 1, y, shader, fb, db, depth_test);
+    }
+    return wrote;
+#endif
+}
+
+enum BlockCoverage {
+    BLOCK_OUTSIDE, BLOCK_PARTIAL, BLOCK_INSIDE
+};
+
+// classify one edge over the block at (x, y), (w, h) being the offset of its bottom right
+// pixel, and return its block local value at (x, y) in F.
+// across a block the edge function moves by less than 2^28, so starting from the corner value
+// (sign-extended when it lives in a 24 bit ring) it is exactly linear and its extremes are at
+// the corners: if they all agree on the sign bit, so does every pixel in between. the block
+// local value is the exact one for an edge crossing the block, for an edge the block is inside
+// of it is shifted to start from 0 at its lowest corner: either way it fits 32 bits and keeps
+// the sign of every pixel.
+inline BlockCoverage classify_edge(const TriangleSetup &setup, long long F_0, int DFDX, int DFDY,
+                                          int x, int y, int w, int h, int &F) {
+    long long c0 = F_0 + (long long) DFDX * x + (long long) DFDY * y;
+    long long ring = 1LL << 62;
+    if (setup.edge_bits == 24) {
+        c0 = ((c0 & 0xffffff) ^ 0x800000) - 0x800000;
+        ring = 0x800000;
+    }
+    long long c1 = c0 + (long long) DFDX * w;
+    long long c2 = c0 + (long long) DFDY * h;
+    long long c3 = c1 + (long long) DFDY * h;
+    long long lo = std::min(std::min(c0, c1), std::min(c2, c3));
+    long long hi = std::max(std::max(c0, c1), std::max(c2, c3));
+    if (lo >= 0 && hi < ring) {
+        F = (int) (c0 - lo);
+        return BLOCK_INSIDE;
+    }
+    if (lo >= -ring && hi < 0) return BLOCK_OUTSIDE;
+    F = (int) c0;
+    return BLOCK_PARTIAL;
+}
+
+inline BlockCoverage classify_block(const TriangleSetup &setup, int x, int y, int w, int h,
+                                           Interpolants &p) {
+    BlockCoverage c01 = classify_edge(setup, setup.F01_0, setup.DF01DX, setup.DF01DY, x, y, w, h, p.F01);
+    if (c01 == BLOCK_OUTSIDE) return BLOCK_OUTSIDE;
+    BlockCoverage c12 = classify_edge(setup, setup.F12_0, setup.DF12DX, setup.DF12DY, x, y, w, h, p.F12);
+    if (c12 == BLOCK_OUTSIDE) return BLOCK_OUTSIDE;
+    BlockCoverage c20 = classify_edge(setup, setup.F20_0, setup.DF20DX, setup.DF20DY, x, y, w, h, p.F20);
+    return std::min(c01, std::min(c12, c20));
+}
+
+// depth of the triangle's plane at pixel (x, y), not wrapped to 16 bits.
+inline int plane_depth(const TriangleSetup &setup, int x, int y) {
+    return setup.d0 + setup.DZDX * (x - setup.x0) + setup.DZDY * (y - setup.y0);
+}
+
+// depth range of the triangle's plane over a block, false if it wraps around 16 bits there.
+inline bool block_depth_range(const TriangleSetup &setup, int x, int y, int w, int h,
+                                     int &z_min, int &z_max) {
+    int z = plane_depth(setup, x, y);
+    int zx = setup.DZDX * w, zy = setup.DZDY * h;
+    z_min = z + std::min(zx, 0) + std::min(zy, 0);
+    z_max = z + std::max(zx, 0) + std::max(zy, 0);
+    return z_min >= 0 && z_max <= 0xffff;
+}
+
+// cut the pixels [x0, x1) of row y down to the ones whose unwrapped depth lies in 16 bits. depth
+// is linear along the row, so those are one run.
+inline void depth_clip_span(const TriangleSetup &setup, int y, int &x0, int &x1) {
+    auto inside = [&](int x) {
+        int z = plane_depth(setup, x, y);
+        return z >= 0 && z <= 0xffff;
+    };
+    while (x0 < x1 && !inside(x0)) x0++;
+    while (x1 > x0 && !inside(x1 - 1)) x1--;
+}
+
+// raster_span() of the pixels [x0, x1) of row y of a depth_clamp setup, p holding the
+// interpolants at x0: the run whose depth lies in 16 bits as it is, the pixels either side of it
+// with the depth of the end they are past, as a flat plane.
+template<class State, bool edge_test, class Shader>
+inline bool raster_span_clamped(const TriangleSetup &setup, const Interpolants &p, int x0, int x1, int y,
+                                const Shader &shader, unsigned int *fb, unsigned short *db, bool depth_test) {
+    int in0 = x0, in1 = x1;
+    depth_clip_span(setup, y, in0, in1);
+    TriangleSetup flat = setup;
+    flat.DZDX = 0;
+    bool wrote = false;
+    // pixels [a, b) with plane, at depth z, or the plane's own depth when z < 0.
+    auto run = [&](const TriangleSetup &plane, int a, int b, int z) {
+        if (a >= b) return;
+        Interpolants q = p;
+        step_x(q, setup, a - x0);
+        if (z >= 0) q.Z = z;
+        wrote |= raster_span<State, edge_test>(plane, q, a, b, y, shader, fb, db, depth_test);
+    };
+    // every pixel on one side when none is inside, a gradient being too small to step over 16 bits.
+    if (in0 == in1) in0 = in1 = x1;
+    run(flat, x0, in0, plane_depth(setup, x0, y) < 0 ? 0 : 0xffff);
+    run(setup, in0, in1, -1);
+    run(flat, in1, x1, plane_depth(setup, x1 - 1, y) < 0 ? 0 : 0xffff);
+    return wrote;
+}
+
+// the triangle's depth over the block holding pixel (x, y). planes are evaluated in 16 bits, where
+// the steps cut to short are the same.
+inline DepthPlane block_plane(const TriangleSetup &setup, int x, int y) {
+    x &= ~(BLOCK_SIZE - 1);
+    y &= ~(BLOCK_SIZE - 1);
+    auto z = (unsigned short) (setup.d0 + setup.DZDX * (x - setup.x0) + setup.DZDY * (y - setup.y0));
+    return DepthPlane{z, (short) setup.DZDX, (short) setup.DZDY};
+}
+
+enum HiZResult {
+    HIZ_REJECT, HIZ_TEST, HIZ_ACCEPT
+};
+
+// what the depth test does over a block, from the triangle's depth range there and the
+// range already in the buffer.
+template<DepthFunc F>
+inline HiZResult hiz_test(int z_min, int z_max, int db_min, int db_max) {
+    switch (F) {
+        case DEPTH_LESS:
+            return z_min >= db_max ? HIZ_REJECT : (z_max < db_min ? HIZ_ACCEPT : HIZ_TEST);
+        case DEPTH_EQUAL:
+            return z_max < db_min || z_min > db_max ? HIZ_REJECT : HIZ_TEST;
+        case DEPTH_LEQUAL:
+            return z_min > db_max ? HIZ_REJECT : (z_max <= db_min ? HIZ_ACCEPT : HIZ_TEST);
+        case DEPTH_GREATER:
+            return z_max <= db_min ? HIZ_REJECT : (z_min > db_max ? HIZ_ACCEPT : HIZ_TEST);
+        case DEPTH_NOTEQUAL:
+            return z_max < db_min || z_min > db_max ? HIZ_ACCEPT : HIZ_TEST;
+        case DEPTH_GEQUAL:
+            return z_max < db_min ? HIZ_REJECT : (z_min >= db_max ? HIZ_ACCEPT : HIZ_TEST);
+        default:
+            return HIZ_TEST;
+    }
+}
+
+template<class State, class Shader>
+void raster_blocks(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target, const Shader &shader) {
+    if (State::depth_func == DEPTH_NEVER) return;
+    int min_x = std::max((int) setup.min_x, rect.min_x);
+    int max_x = std::min((int) setup.max_x, rect.max_x);
+    int min_y = std::max((int) setup.min_y, rect.min_y);
+    int max_y = std::min((int) setup.max_y, rect.max_y);
+    if (min_x >= max_x || min_y >= max_y) return;
+    HiZBuffer *hiz = State::depth_func != DEPTH_ALWAYS ? target.hiz : nullptr;
+    DepthPlanes *planes = State::depth_func != DEPTH_ALWAYS || State::depth_write ? target.planes : nullptr;
+
+    // a box inside one block, whose rows lie inside rect, is a stamp: the block is walked at full
+    // width, and triangles covering no pixel center are dropped before anything is read.
+    bool stamp = !setup.depth_clip && !setup.depth_clamp &&
+                 ((min_x ^ (max_x - 1)) | (min_y ^ (max_y - 1))) < BLOCK_SIZE &&
+                 (min_x & ~(BLOCK_SIZE - 1)) + BLOCK_SIZE <= rect.max_x;
+
+    // coarse pass over the BLOCK_SIZE aligned blocks of the box: skip the ones outside the
+    // triangle or failing the depth test as a whole, fill the ones inside without edge tests,
+    // skip the depth test where the Hi-Z says it always passes, and only test pixels of the rest.
+    for (int by = min_y, by1; by < max_y; by = by1) {
+        by1 = std::min((by & ~(BLOCK_SIZE - 1)) + BLOCK_SIZE, max_y);
+        for (int bx = stamp ? min_x & ~(BLOCK_SIZE - 1) : min_x, bx1; bx < max_x; bx = bx1) {
+            bx1 = stamp ? bx + BLOCK_SIZE : std::min((bx & ~(BLOCK_SIZE - 1)) + BLOCK_SIZE, max_x);
+            Interpolants block{};
+            BlockCoverage coverage = classify_block(setup, bx, by, bx1 - bx - 1, by1 - by - 1, block);
+            if (coverage == BLOCK_OUTSIDE) continue;
+
+            // the stamp's pixels inside both the box and the triangle.
+            unsigned long long stamp_bits = 0;
+            if (stamp) {
+                unsigned long long columns = ((1ull << (max_x - bx)) - 1) & ~((1ull << (min_x - bx)) - 1);
+                stamp_bits = stamp_coverage(setup, block, by1 - by) & (columns * 0x0101010101010101ull);
+                if (stamp_bits == 0) continue;
+                coverage = ~stamp_bits == 0 ? BLOCK_INSIDE : BLOCK_PARTIAL;
+            }
+
+            // with depth_clip, blocks past the near or far plane as a whole are skipped, and the rows
+            // of the ones crossing either are cut to the pixels in between. with depth_clamp, the
+            // rows of the blocks leaving 16 bits are saturated instead.
+            int z_min, z_max;
+            bool in_range = block_depth_range(setup, bx, by, bx1 - bx - 1, by1 - by - 1, z_min, z_max);
+            bool depth_cut = setup.depth_clip && !in_range;
+            bool depth_clamp = setup.depth_clamp && !in_range;
+            if (depth_cut && (z_max < 0 || z_min > 0xffff)) continue;
+
+            bool depth_test = State::depth_func != DEPTH_ALWAYS;
+            unsigned int hiz_index = 0;
+            if (hiz) {
+                hiz_index = hiz->index(bx, by);
+                if (in_range) {
+                    HiZResult result = hiz_test<State::depth_func>(z_min, z_max, hiz->zmin[hiz_index],
+                                                                   hiz->zmax[hiz_index]);
+                    if (result == HIZ_REJECT) continue;
+                    depth_test = result == HIZ_TEST;
+                }
+            }
+
+            // the depth of a compressed block is expanded into packed, tested and written there, and
+            // compressed again. a block the triangle covers and passes everywhere is just its plane.
+            alignas(16) unsigned short packed[BLOCK_SIZE * BLOCK_SIZE];
+            unsigned int plane_index = 0;
+            bool compressed = false, covered = false;
+            if (planes) {
+                plane_index = planes->index(bx, by);
+                covered = State::depth_write && !Shader::discards && coverage == BLOCK_INSIDE && !depth_test &&
+                          in_range && planes->covers(bx, by, bx1, by1);
+                compressed = covered || planes->compressed(plane_index);
+                if (compressed && !covered) planes->expand(plane_index, packed);
+            }
+
+            bool wrote = false;
+            attributes_at(block, setup, bx, by);
+            Interpolants row = block;
+            for (int iy = by; iy < by1; iy += (1)) {
+                unsigned int *fb = pixel_row(target.fb, target.layout, target.stride, bx, iy);
+                unsigned short *db = compressed ?
+                                     packed + (iy & (BLOCK_SIZE - 1)) * BLOCK_SIZE - (bx & ~(BLOCK_SIZE - 1)) :
+                                     pixel_row(target.db, target.layout, target.stride, bx, iy);
+                int x0 = bx, x1 = bx1;
+                Interpolants span = row;
+                if (depth_cut) {
+                    depth_clip_span(setup, iy, x0, x1);
+                    step_x(span, setup, x0 - bx);
+                }
+                if (depth_clamp && coverage == BLOCK_INSIDE) {
+                    wrote |= raster_span_clamped<State, false>(setup, span, x0, x1, iy, shader, fb, db, depth_test);
+                } else if (depth_clamp) {
+                    wrote |= raster_span_clamped<State, true>(setup, span, x0, x1, iy, shader, fb, db, depth_test);
+                } else if (stamp) {
+                    auto bits = (unsigned int) (stamp_bits >> ((iy - by) * BLOCK_SIZE)) & 0xff;
+                    if (bits) wrote |= raster_stamp_row<State>(setup, span, bits, bx, iy, shader, fb, db, depth_test);
+                } else if (x0 < x1 && coverage == BLOCK_INSIDE) {
+                    wrote |= raster_span<State, false>(setup, span, x0, x1, iy, shader, fb, db, depth_test);
+                } else if (x0 < x1) {
+                    wrote |= raster_span<State, true>(setup, span, x0, x1, iy, shader, fb, db, depth_test);
+                }
+                step_y(row, setup);
+            }
+            if (!wrote) continue;
+            if (!compressed) {
+                if (target.hiz) target.hiz->update(bx, by, target.db, target.stride, target.layout);
+            } else if (State::depth_write) {
+                DepthPlane plane = block_plane(setup, bx, by);
+                if (covered) planes->set(plane_index, plane);
+                else planes->store(plane_index, packed, plane, target.db, target.stride, target.layout);
+                if (target.hiz) target.hiz->update(bx, by, packed);
+            }
+        }
+    }
+}
+
+template<class State, class Shader>
+void raster_triangle(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target, const void *uniforms) {
+    Shader shader(static_cast<const typename Shader::Uniforms *>(uniforms), setup);
+    raster_blocks<State>(setup, rect, target, shader);
+}
+
+// every permutation of StaticRasterState, indexed by raster_state_index.
+static const int RASTER_STATE_COUNT = (DEPTH_ALWAYS + 1) * 2 * 2 * (BLEND_ALPHA + 1);
+
+inline int raster_state_index(DepthFunc depth_func, bool depth_write, bool color_write, BlendMode blend) {
+    return ((depth_func * 2 + depth_write) * 2 + color_write) * (BLEND_ALPHA + 1) + blend;
+}
+
+template<int I>
+using StaticRasterStateOf = StaticRasterState<(DepthFunc) (I / (4 * (BLEND_ALPHA + 1))),
+        (I / (2 * (BLEND_ALPHA + 1))) % 2 != 0, (I / (BLEND_ALPHA + 1)) % 2 != 0, (BlendMode) (I % (BLEND_ALPHA + 1))>;
+
+template<class Shader, int... I>
+constexpr std::array<RasterFunc, sizeof...(I)> make_raster_table(std::integer_sequence<int, I...>) {
+    return {{&raster_triangle<StaticRasterStateOf<I>, Shader>...}};
+}
+
+// select_raster() for the raster loops of Shader, their uniforms are a const Shader::Uniforms *.
+template<class Shader>
+RasterFunc select_raster(const RasterState &state) {
+    static constexpr auto table = make_raster_table<Shader>(std::make_integer_sequence<int, RASTER_STATE_COUNT>());
+    // no depth test means no depth write either.
+    if (!state.depth_test) return table[raster_state_index(DEPTH_ALWAYS, false, state.color_write, state.blend)];
+    return table[raster_state_index(state.depth_func, state.depth_write, state.color_write, state.blend)];
+}
+
+// shade_span() with Shader. pixels it discards keep their colour.
+template<class Shader>
+void shade_span(const TriangleSetup &setup, int x, int y, int n, const void *uniforms, unsigned int *fb) {
+    Shader shader(static_cast<const typename Shader::Uniforms *>(uniforms), setup);
+    Interpolants p{};
+    attributes_at(p, setup, x, y);
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), mask = _mm256_set1_epi32(0xfff);
+    for (; i + 8 <= n; i += 8, step_x(p, setup, 8)) {
+        __m256i Z = _mm256_add_epi32(_mm256_set1_epi32(p.Z), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DZDX)));
+        __m256i U = _mm256_add_epi32(_mm256_set1_epi32(p.U), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DUDX)));
+        __m256i V = _mm256_add_epi32(_mm256_set1_epi32(p.V), _mm256_mullo_epi32(lane, _mm256_set1_epi32(setup.DVDX)));
+        Fragment8 in{x + i, y, _mm256_and_si256(Z, _mm256_set1_epi32(0xffff)), _mm256_and_si256(U, mask),
+                     _mm256_and_si256(V, mask)};
+        __m256i color;
+        __m256i keep = shade_lanes(shader, in, color);
+        _mm256_maskstore_epi32(reinterpret_cast<int *>(fb + i), keep, color);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4, step_x(p, setup, 4)) {
+        __m128i Z = _mm_setr_epi32(p.Z, p.Z + setup.DZDX, p.Z + setup.DZDX * 2, p.Z + setup.DZDX * 3);
+        __m128i U = _mm_setr_epi32(p.U, p.U + setup.DUDX, p.U + setup.DUDX * 2, p.U + setup.DUDX * 3);
+        __m128i V = _mm_setr_epi32(p.V, p.V + setup.DVDX, p.V + setup.DVDX * 2, p.V + setup.DVDX * 3);
+        Fragment4 in{x + i, y, _mm_and_si128(Z, _mm_set1_epi32(0xffff)), _mm_and_si128(U, _mm_set1_epi32(0xfff)),
+                     _mm_and_si128(V, _mm_set1_epi32(0xfff))};
+        __m128i color;
+        __m128i keep = shade_lanes(shader, in, color);
+        __m128i C = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fb + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(fb + i),
+                         _mm_or_si128(_mm_and_si128(keep, color), _mm_andnot_si128(keep, C)));
+    }
+#endif
+    for (; i < n; i++, step_x(p, setup, 1)) {
+        unsigned int color;
+        if (shader.shade(Fragment{x + i, y, p.Z, p.U, p.V}, color)) fb[i] = color;
+    }
+}
+
+// Shader as a FragmentProgram, handing uniforms to the triangles drawn with it.
+template<class Shader>
+FragmentProgram fragment_program(const typename Shader::Uniforms *uniforms) {
+    return FragmentProgram{&select_raster<Shader>, &shade_span<Shader>, uniforms, Shader::discards};
+}
+
+#endif //SIMPLE_SOFT_RASTERIZER_RASTER_LOOP_H
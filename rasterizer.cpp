@@ -1,4 +1,7 @@
-#include "vertex.h"
+#include <cmath>
+
+#include "rasterizer.h"
+#include "raster_loop.h"
 #include "utils.h"
 
 #ifndef min
@@ -34,32 +37,52 @@ bool in_side(int face_id, const glm::vec4 p) {
     }
 }
 
-Vertex intersect(int face_id, const Vertex &v1, const Vertex &v2) {
+// vertex i of polygon.
+static glm::vec4 polygon_position(const ClipPolygon &polygon, int i) {
+    return glm::vec4(polygon.x[i], polygon.y[i], polygon.z[i], polygon.w[i]);
+}
+
+static Vertex polygon_vertex(const ClipPolygon &polygon, int i) {
+    return Vertex(polygon_position(polygon, i), glm::vec2(polygon.u[i], polygon.v[i]));
+}
+
+static void polygon_store(ClipPolygon &polygon, int i, const Vertex &vertex) {
+    polygon.x[i] = vertex.position[0];
+    polygon.y[i] = vertex.position[1];
+    polygon.z[i] = vertex.position[2];
+    polygon.w[i] = vertex.position[3];
+    polygon.u[i] = vertex.texcoord[0];
+    polygon.v[i] = vertex.texcoord[1];
+}
+
+// dst[k] = where the edge from src[a] to src[b] crosses plane face_id.
+static void intersect(int face_id, const ClipPolygon &src, int a, int b, ClipPolygon &dst, int k) {
+    glm::vec4 v1 = polygon_position(src, a), v2 = polygon_position(src, b);
     float d1, d2;
     switch (face_id) {
         case 0:
-            d1 = v1.position[2] + v1.position[3];
-            d2 = v2.position[2] + v2.position[3];
+            d1 = v1[2] + v1[3];
+            d2 = v2[2] + v2[3];
             break;
         case 1:
-            d1 = -v1.position[2] + v1.position[3];
-            d2 = -v2.position[2] + v2.position[3];
+            d1 = -v1[2] + v1[3];
+            d2 = -v2[2] + v2[3];
             break;
         case 2:
-            d1 = v1.position[0] + v1.position[3];
-            d2 = v2.position[0] + v2.position[3];
+            d1 = v1[0] + v1[3];
+            d2 = v2[0] + v2[3];
             break;
         case 3:
-            d1 = -v1.position[0] + v1.position[3];
-            d2 = -v2.position[0] + v2.position[3];
+            d1 = -v1[0] + v1[3];
+            d2 = -v2[0] + v2[3];
             break;
         case 4:
-            d1 = -v1.position[1] + v1.position[3];
-            d2 = -v2.position[1] + v2.position[3];
+            d1 = -v1[1] + v1[3];
+            d2 = -v2[1] + v2[3];
             break;
         case 5:
-            d1 = v1.position[1] + v1.position[3];
-            d2 = v2.position[1] + v2.position[3];
+            d1 = v1[1] + v1[3];
+            d2 = v2[1] + v2[3];
             break;
         default:
             d1 = 1.f;
@@ -68,43 +91,106 @@ Vertex intersect(int face_id, const Vertex &v1, const Vertex &v2) {
     }
 
     float weight = d1 / (d1 - d2);
-    Vertex ret{lerp(v1.position, v2.position, weight), lerp(v1.texcoord, v2.texcoord, weight)};
-    return ret;
+    auto mix = [&](const float *in, float *out) { out[k] = (1.0f - weight) * in[a] + weight * in[b]; };
+    mix(src.x, dst.x);
+    mix(src.y, dst.y);
+    mix(src.z, dst.z);
+    mix(src.w, dst.w);
+    mix(src.u, dst.u);
+    mix(src.v, dst.v);
+}
+
+unsigned int clip_outcode(const glm::vec4 &p) {
+    // bit i set where in_side(i, p) fails, NaN counting as outside as well.
+    unsigned int code = 0;
+    if (!(p[2] >= -p[3])) code |= 1u << 0;
+    if (!(p[2] <= p[3])) code |= 1u << 1;
+    if (!(p[0] >= -p[3])) code |= 1u << 2;
+    if (!(p[0] <= p[3])) code |= 1u << 3;
+    if (!(p[1] <= p[3])) code |= 1u << 4;
+    if (!(p[1] >= -p[3])) code |= 1u << 5;
+    return code;
+}
+
+unsigned int clip_outcode(const glm::vec4 &p, float guard_x, float guard_y) {
+    unsigned int code = clip_outcode(p);
+    if (!(p[0] >= -guard_x * p[3])) code |= 1u << 6;
+    if (!(p[0] <= guard_x * p[3])) code |= 1u << 7;
+    if (!(p[1] <= guard_y * p[3])) code |= 1u << 8;
+    if (!(p[1] >= -guard_y * p[3])) code |= 1u << 9;
+    return code;
 }
 
-// return value: number of triangle generated.
+// return value: number of vertices of the clipped polygon, at most FAN_MAX_VERTICES.
 int triangle_clip(const Vertex input[3], Vertex output[]) {
-    // input and output should be in clip space.
-    int buf_cnt = 0;
-    Vertex buf[18];
-    int output_cnt = 3;
-    output[0] = input[0];
-    output[1] = input[1];
-    output[2] = input[2];
+    unsigned int codes[3] = {clip_outcode(input[0].position), clip_outcode(input[1].position),
+                             clip_outcode(input[2].position)};
+    return triangle_clip(input, codes, output);
+}
+
+// polygon[0, 3), a triangle, clipped to the planes of crossed. return its vertex count.
+static int polygon_clip(ClipPolygon &polygon, unsigned int crossed) {
+    // every pass adds at most one vertex, passes go back and forth between polygon and buf.
+    ClipPolygon buf;
+    ClipPolygon *src = &polygon, *dst = &buf;
+    int src_cnt = 3;
     for (int i = 0; i < 6; i++) {
-        buf_cnt = 0;
-        for (int j = 0; j < output_cnt; j++) {
-            buf[buf_cnt++] = output[j];
-        }
-        output_cnt = 0;
-        Vertex last = buf[buf_cnt - 1];
-        bool last_in_side = in_side(i, last.position);
-        for (int j = 0; j < buf_cnt; j++) {
-            Vertex cur = buf[j];
-            bool cur_in_side = in_side(i, cur.position);
+        if (!(crossed & (1u << i))) continue;
+        int dst_cnt = 0;
+        int last = src_cnt - 1;
+        bool last_in_side = in_side(i, polygon_position(*src, last));
+        for (int cur = 0; cur < src_cnt; cur++) {
+            bool cur_in_side = in_side(i, polygon_position(*src, cur));
             if (cur_in_side) {
                 if (!last_in_side) {
-                    output[output_cnt++] = intersect(i, last, cur);
+                    intersect(i, *src, last, cur, *dst, dst_cnt++);
                 }
-                output[output_cnt++] = cur;
+                dst->x[dst_cnt] = src->x[cur];
+                dst->y[dst_cnt] = src->y[cur];
+                dst->z[dst_cnt] = src->z[cur];
+                dst->w[dst_cnt] = src->w[cur];
+                dst->u[dst_cnt] = src->u[cur];
+                dst->v[dst_cnt++] = src->v[cur];
             } else if (last_in_side) {
-                output[output_cnt++] = intersect(i, last, cur);
+                intersect(i, *src, last, cur, *dst, dst_cnt++);
             }
             last = cur;
             last_in_side = cur_in_side;
         }
+        if (!dst_cnt) return 0;
+        std::swap(src, dst);
+        src_cnt = dst_cnt;
+    }
+    if (src != &polygon) polygon = *src;
+    return src_cnt;
+}
+
+int triangle_clip(const Vertex input[3], const unsigned int codes[3], Vertex output[]) {
+    // input and output should be in clip space.
+    // outside of one plane as a whole, nothing left.
+    if (codes[0] & codes[1] & codes[2] & CLIP_VIEW) return 0;
+    ClipPolygon polygon;
+    for (int i = 0; i < 3; i++) polygon_store(polygon, i, input[i]);
+    int n = polygon_clip(polygon, (codes[0] | codes[1] | codes[2]) & CLIP_VIEW);
+    for (int i = 0; i < n; i++) output[i] = polygon_vertex(polygon, i);
+    return n;
+}
+
+int triangle_clip(const VertexStream &stream, const unsigned int indices[3], const unsigned int codes[3],
+                  ClipPolygon &output) {
+    if (codes[0] & codes[1] & codes[2] & CLIP_VIEW) return 0;
+    for (int i = 0; i < 3; i++) {
+        const VertexBatch &batch = stream[indices[i] / VERTEX_BATCH];
+        unsigned int j = indices[i] % VERTEX_BATCH;
+        output.x[i] = batch.x[j];
+        output.y[i] = batch.y[j];
+        output.z[i] = batch.z[j];
+        output.w[i] = batch.w[j];
+        output.u[i] = batch.u[j];
+        output.v[i] = batch.v[j];
     }
-    return output_cnt;
+    // only the planes some vertex is outside of cut the triangle, the rest would keep it as is.
+    return polygon_clip(output, (codes[0] | codes[1] | codes[2]) & CLIP_VIEW);
 }
 
 void perspective_division(const Vertex &input, Vertex &output) {
@@ -120,21 +206,59 @@ void screen_transform(const Vertex &input, Vertex &out, float width, float heigh
     out.texcoord = input.texcoord;
     out.position[0] = (input.position[0] * width + width) / 2;
     out.position[1] = (input.position[1] * height + height) / 2;
+    // depth is nearer when larger: the near plane maps to 1, the far one to 0.
+    out.position[2] = (1.f - input.position[2]) / 2;
+    out.position[3] = input.position[3];
     // output here should be in screen space
 }
 
+void polygon_screen_transform(ClipPolygon &polygon, int n, float width, float height) {
+    // the operations of perspective_division() and screen_transform(), in the same order.
+    for (int i = 0; i < n; i++) {
+        float w = polygon.w[i];
+        polygon.x[i] = (polygon.x[i] / w * width + width) / 2;
+        polygon.y[i] = (polygon.y[i] / w * height + height) / 2;
+        polygon.z[i] = (1.f - polygon.z[i] / w) / 2;
+    }
+}
+
+void homogeneous_screen_transform(const Vertex &input, Vertex &out, float width, float height) {
+    // input here should be in clip space, screen_transform() of NDC times w.
+    float w = input.position[3];
+    out.texcoord = input.texcoord;
+    out.position[0] = (input.position[0] + w) * width / 2;
+    out.position[1] = (input.position[1] + w) * height / 2;
+    out.position[2] = (w - input.position[2]) / 2;
+    out.position[3] = w;
+}
+
+// depth steps and starts saturated to what plane_depth() can take over a box of up to 4096
+// pixels in 32 bits. a step past 2^17 leaves 16 bits within a pixel anyway.
+static int depth_step(long long dz) {
+    return (int) max(min(dz, 1LL << 17), -(1LL << 17));
+}
+
+static int depth_start(long long z) {
+    return (int) max(min(z, 1LL << 29), -(1LL << 29));
+}
+
+// depth_clamp for setups whose depth plane leaves 16 bits somewhere in the box.
+static void depth_range_clamp(TriangleSetup &setup) {
+    int z_min, z_max;
+    setup.depth_clamp = !block_depth_range(setup, setup.min_x, setup.min_y, setup.max_x - setup.min_x - 1,
+                                           setup.max_y - setup.min_y - 1, z_min, z_max);
+}
+
 short ext12b(short in) {
     return in | ((in & 0x800) ? 0xf000 : 0x0000);
 }
 
-void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const char *tex,
-                           unsigned short *db, unsigned int *fb) {
+bool triangle_setup(const Vertex input[3], const Rect &scissor, TriangleSetup &setup) {
     // predeclear : input here should be in screen space
     // 0 - 1023.0f
 
     // convert parameters into fixed-points.
     // signed 12.0 -1024 - 1023.
-    short max_x, max_y, min_x, min_y;
     short x[3], y[3];
     unsigned short d[3];
     // signed 12.0
@@ -147,10 +271,13 @@ void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned i
         u[i] = (unsigned short) (input[i].texcoord[0] * 4095.f);
         v[i] = (unsigned short) (input[i].texcoord[1] * 4095.f);
     }
-    max_x = max(x[0], max(x[1], x[2]));
-    min_x = min(x[0], min(x[1], x[2]));
-    max_y = max(y[0], max(y[1], y[2]));
-    min_y = min(y[0], min(y[1], y[2]));
+    // the loops below never leave the scissor rectangle, drop the triangle before any
+    // division when nothing is left of it.
+    setup.max_x = (short) min((int) max(x[0], max(x[1], x[2])), scissor.max_x);
+    setup.min_x = (short) max((int) min(x[0], min(x[1], x[2])), scissor.min_x);
+    setup.max_y = (short) min((int) max(y[0], max(y[1], y[2])), scissor.max_y);
+    setup.min_y = (short) max((int) min(y[0], min(y[1], y[2])), scissor.min_y);
+    if (setup.min_x >= setup.max_x || setup.min_y >= setup.max_y) return false;
     // signed 12.0 -2048 - 2047.
     short DF01DX, DF12DX, DF20DX, DF01DY, DF12DY, DF20DY;
     // signed 24.0
@@ -165,56 +292,666 @@ void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned i
     F12_0 = (((x[1] * y[2])) - ((x[2] * y[1]))) & 0xffffff;
     F20_0 = (((x[2] * y[0])) - ((x[0] * y[2]))) & 0xffffff;
     int delta = (F01_0 + F12_0 + F20_0) & 0xffffff;
-    if (delta & 0x800000) return;
-    int F01_y, F12_y, F20_y;
-    unsigned short Z_y, U_y, V_y;
-    short DZDX, DZDY, DUDX, DUDY, DVDX, DVDY;
+    // back facing, or zero area (which would divide by zero below).
+    if ((delta & 0x800000) || delta == 0) return false;
 
-    // 24b begin 24b * 3 = 72b
-    F01_y = (F01_0 + ((ext12b(DF01DX) * min_x)) + ((ext12b(DF01DY) * min_y))) & 0xffffff;
-    F12_y = (F12_0 + ((ext12b(DF12DX) * min_x)) + ((ext12b(DF12DY) * min_y))) & 0xffffff;
-    F20_y = (F20_0 + ((ext12b(DF20DX) * min_x)) + ((ext12b(DF20DY) * min_y))) & 0xffffff;
+    setup.x0 = x[0];
+    setup.y0 = y[0];
+    setup.d0 = d[0];
+    setup.u0 = u[0];
+    setup.v0 = v[0];
+    setup.F01_0 = F01_0;
+    setup.F12_0 = F12_0;
+    setup.F20_0 = F20_0;
+    setup.DF01DX = ext12b(DF01DX);
+    setup.DF12DX = ext12b(DF12DX);
+    setup.DF20DX = ext12b(DF20DX);
+    setup.DF01DY = ext12b(DF01DY);
+    setup.DF12DY = ext12b(DF12DY);
+    setup.DF20DY = ext12b(DF20DY);
 
     // 12b begin 12b * 6 = 72b
-    DZDX = (short) ((ext12b(DF20DX) * (d[1] - d[0]) + ext12b(DF01DX) * (d[2] - d[0])) / delta);
-    DZDY = (short) ((ext12b(DF20DY) * (d[1] - d[0]) + ext12b(DF01DY) * (d[2] - d[0])) / delta);
-    DUDX = (short) (((ext12b(DF20DX) * (u[1] - u[0]) + ext12b(DF01DX) * (u[2] - u[0])) / delta) & 0xfff);
-    DUDY = (short) (((ext12b(DF20DY) * (u[1] - u[0]) + ext12b(DF01DY) * (u[2] - u[0])) / delta) & 0xfff);
-    DVDX = (short) (((ext12b(DF20DX) * (v[1] - v[0]) + ext12b(DF01DX) * (v[2] - v[0])) / delta) & 0xfff);
-    DVDY = (short) (((ext12b(DF20DY) * (v[1] - v[0]) + ext12b(DF01DY) * (v[2] - v[0])) / delta) & 0xfff);
-    Z_y = (short) (d[0] + DZDX * (min_x - x[0]) + DZDY * (min_y - y[0]));
-    U_y = (short) ((u[0] + ext12b(DUDX) * (min_x - x[0]) + ext12b(DUDY) * (min_y - y[0])));
-    V_y = (short) ((v[0] + ext12b(DVDX) * (min_x - x[0]) + ext12b(DVDY) * (min_y - y[0])) & 0xfff);
-    for (signed short iy = min_y; iy < max_y; iy += (1)) {
-        int F01_x = F01_y;
-        int F12_x = F12_y;
-        int F20_x = F20_y;
-        unsigned short Z_x = Z_y;
-        unsigned short U_x = U_y;
-        unsigned short V_x = V_y;
-        for (signed short ix = min_x; ix < max_x; ix += (1)) {
-            unsigned int addr = (iy) * width + (ix);
-            if (((F01_x | F12_x | F20_x) & 0x800000) == 0) {
-                if (Z_x >= db[addr]) {
-                    db[addr] = Z_x;
-                    fb[addr] = 0xff000000 | (((U_x >> 4) & 0xff) << 8) | (((V_x >> 4) & 0xff) << 0);
-                }
-            }
-//            else {
-//                fb[(iy) * width + (ix)] = 0xffffffff;
-//            }
-            F01_x = (F01_x + ext12b(DF01DX)) & 0xffffff;
-            F12_x = (F12_x + ext12b(DF12DX)) & 0xffffff;
-            F20_x = (F20_x + ext12b(DF20DX)) & 0xffffff;
-            Z_x = (unsigned short) (Z_x + DZDX);
-            U_x = (short) ((U_x + ext12b(DUDX)) & 0xfff);
-            V_x = (short) ((V_x + ext12b(DVDX)) & 0xfff);
+    setup.DZDX = depth_step((setup.DF20DX * (d[1] - d[0]) + setup.DF01DX * (d[2] - d[0])) / delta);
+    setup.DZDY = depth_step((setup.DF20DY * (d[1] - d[0]) + setup.DF01DY * (d[2] - d[0])) / delta);
+    setup.DUDX = ext12b((short) (((setup.DF20DX * (u[1] - u[0]) + setup.DF01DX * (u[2] - u[0])) / delta) & 0xfff));
+    setup.DUDY = ext12b((short) (((setup.DF20DY * (u[1] - u[0]) + setup.DF01DY * (u[2] - u[0])) / delta) & 0xfff));
+    setup.DVDX = ext12b((short) (((setup.DF20DX * (v[1] - v[0]) + setup.DF01DX * (v[2] - v[0])) / delta) & 0xfff));
+    setup.DVDY = ext12b((short) (((setup.DF20DY * (v[1] - v[0]) + setup.DF01DY * (v[2] - v[0])) / delta) & 0xfff));
+    setup.edge_bits = 24;
+    setup.depth_clip = false;
+    depth_range_clamp(setup);
+    return true;
+}
+
+// a vertex in the fixed point of triangle_setup<INT_BITS, FRAC_BITS>.
+struct FixedVertex {
+    // signed INT_BITS.FRAC_BITS
+    long long x, y;
+    unsigned short d;
+    // unsigned 0.12
+    unsigned short u, v;
+};
+
+// an edge function at sub-pixel (x, y): F_0 + DX * x + DY * y, before the fill rule.
+struct FixedEdge {
+    // signed (INT_BITS + FRAC_BITS + 1).0
+    long long F_0, DX, DY;
+};
+
+// lroundf(x) (halves away from zero) inline instead of a libm call, |x| clamped to 2^30 first,
+// which is past any fixed-point range the setups take.
+static inline int snap(float x) {
+    const double limit = 1073741824.0;
+    double m = std::fabs((double) x) + 0.5;
+    auto i = (int) (m < limit ? m : limit);
+    return x < 0 ? -i : i;
+}
+
+// snap(in[i] * scale) of every lane.
+static inline void snap_lanes(const float in[SETUP_BATCH], float scale, int out[SETUP_BATCH]) {
+#if defined(__AVX2__)
+    static_assert(SETUP_BATCH == 8, "a batch is one register of floats");
+    __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in), _mm256_set1_ps(scale));
+    const __m256d abs = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    for (int h = 0; h < 2; h++) {
+        __m256d a = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x));
+        // minpd keeps its second operand for NaN, like the compare in snap().
+        __m256d m = _mm256_min_pd(_mm256_add_pd(_mm256_and_pd(a, abs), _mm256_set1_pd(0.5)),
+                                  _mm256_set1_pd(1073741824.0));
+        __m128i i = _mm256_cvttpd_epi32(m);
+        __m128i negative = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+                _mm256_castpd_si256(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_LT_OQ)),
+                _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7)));
+        i = _mm_sub_epi32(_mm_xor_si128(i, negative), negative);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * h), i);
+    }
+#else
+    for (int i = 0; i < SETUP_BATCH; i++) out[i] = snap(in[i] * scale);
+#endif
+}
+
+// false when (x, y), already snapped, is outside of the representable range. the triangle has to
+// be clipped first.
+template<int INT_BITS, int FRAC_BITS>
+static inline bool fixed_range(long long x, long long y) {
+    const long long limit = 1LL << (INT_BITS + FRAC_BITS - 1);
+    return x >= -limit && x < limit && y >= -limit && y < limit;
+}
+
+// false when the vertex is outside of the representable range, it has to be clipped first.
+template<int INT_BITS, int FRAC_BITS>
+static bool fixed_vertex(float x, float y, float z, float u, float v, FixedVertex &out) {
+    const long long one = 1LL << FRAC_BITS;
+    out.x = snap(x * (float) one);
+    out.y = snap(y * (float) one);
+    if (!fixed_range<INT_BITS, FRAC_BITS>(out.x, out.y)) return false;
+    out.d = (unsigned short) snap(z * 65535.f);
+
+    out.u = (unsigned short) (u * 4095.f);
+    out.v = (unsigned short) (v * 4095.f);
+    return true;
+}
+
+template<int INT_BITS, int FRAC_BITS>
+static bool fixed_vertex(const Vertex &input, FixedVertex &out) {
+    return fixed_vertex<INT_BITS, FRAC_BITS>(input.position[0], input.position[1], input.position[2],
+                                             input.texcoord[0], input.texcoord[1], out);
+}
+
+// the edge from a to b, exact. the one from b to a is its negation.
+static FixedEdge fixed_edge(const FixedVertex &a, const FixedVertex &b) {
+    return FixedEdge{a.x * b.y - b.x * a.y, a.y - b.y, b.x - a.x};
+}
+
+static FixedEdge negate(const FixedEdge &e) {
+    return FixedEdge{-e.F_0, -e.DX, -e.DY};
+}
+
+// n / d rounded toward zero like the integer division, from r = 1.0 / d, d > 0. the product is
+// within one of the quotient while |n| < 2^52, the remainder tells which way to correct it.
+static inline long long quotient(long long n, long long d, double r) {
+    long long a = n < 0 ? -n : n;
+    auto q = (long long) ((double) a * r);
+    long long rem = a - q * d;
+    q += (long long) (rem >= d) - (long long) (rem < 0);
+    return n < 0 ? -q : q;
+}
+
+// the part of the setup of triangle (v0, v1, v2) past the rejection tests: edges, gradients and
+// the attribute planes. setup holds the bounding box, delta is the (positive) doubled area and r
+// its reciprocal, all six gradients divide by it.
+template<int INT_BITS, int FRAC_BITS>
+static void fixed_planes(const FixedVertex &v0, const FixedVertex &v1, const FixedVertex &v2,
+                         const FixedEdge &e01, const FixedEdge &e12, const FixedEdge &e20,
+                         long long delta, double r, TriangleSetup &setup) {
+    const long long one = 1LL << FRAC_BITS, half = one >> 1;
+    // top-left fill rule: a sample exactly on an edge belongs to the triangle only when the
+    // edge is a top (horizontal, interior below) or a left one (interior to the right).
+    // the other edges are biased by one so that >= 0 turns into > 0 for them.
+    // the function at pixel center (px, py) is one * (DX * px + DY * py) + (F_0 + (DX + DY) * half),
+    // and its sign only depends on the floor of the constant part divided by one.
+    auto pixel_edge = [&](const FixedEdge &e) {
+        bool top_left = e.DX > 0 || (e.DX == 0 && e.DY > 0);
+        return (e.F_0 + (e.DX + e.DY) * half - (top_left ? 0 : 1)) >> FRAC_BITS;
+    };
+    setup.F01_0 = pixel_edge(e01);
+    setup.F12_0 = pixel_edge(e12);
+    setup.F20_0 = pixel_edge(e20);
+    setup.DF01DX = (int) e01.DX;
+    setup.DF12DX = (int) e12.DX;
+    setup.DF20DX = (int) e20.DX;
+    setup.DF01DY = (int) e01.DY;
+    setup.DF12DY = (int) e12.DY;
+    setup.DF20DY = (int) e20.DY;
+    setup.edge_bits = 64;
+    setup.depth_clip = false;
+
+    // attribute gradients per sub-pixel, scaled to per pixel below.
+    long long ZX = e20.DX * (v1.d - v0.d) + e01.DX * (v2.d - v0.d);
+    long long ZY = e20.DY * (v1.d - v0.d) + e01.DY * (v2.d - v0.d);
+    long long UX = e20.DX * (v1.u - v0.u) + e01.DX * (v2.u - v0.u);
+    long long UY = e20.DY * (v1.u - v0.u) + e01.DY * (v2.u - v0.u);
+    long long VX = e20.DX * (v1.v - v0.v) + e01.DX * (v2.v - v0.v);
+    long long VY = e20.DY * (v1.v - v0.v) + e01.DY * (v2.v - v0.v);
+    setup.DZDX = depth_step(quotient(ZX * one, delta, r));
+    setup.DZDY = depth_step(quotient(ZY * one, delta, r));
+    setup.DUDX = ext12b((short) (quotient(UX * one, delta, r) & 0xfff));
+    setup.DUDY = ext12b((short) (quotient(UY * one, delta, r) & 0xfff));
+    setup.DVDX = ext12b((short) (quotient(VX * one, delta, r) & 0xfff));
+    setup.DVDY = ext12b((short) (quotient(VY * one, delta, r) & 0xfff));
+
+    // the attribute planes start at the pixel holding vertex 0, evaluated at its center. a vertex
+    // off the box (out in the guard band) is moved to its nearest pixel, so the truncated
+    // gradients are not stepped over the pixels in between.
+    setup.x0 = (short) min(max(v0.x >> FRAC_BITS, (long long) setup.min_x), (long long) setup.max_x - 1);
+    setup.y0 = (short) min(max(v0.y >> FRAC_BITS, (long long) setup.min_y), (long long) setup.max_y - 1);
+    long long dx = setup.x0 * one + half - v0.x, dy = setup.y0 * one + half - v0.y;
+    // exact within a pixel of vertex 0. further out the products would not fit, and the offset
+    // is rounded in double.
+    bool exact = dx >= -one && dx <= one && dy >= -one && dy <= one;
+    auto offset = [&](long long GX, long long GY) {
+        if (exact) return quotient(GX * dx + GY * dy, delta, r);
+        return (long long) (((double) GX * (double) dx + (double) GY * (double) dy) * r);
+    };
+    setup.d0 = depth_start(v0.d + offset(ZX, ZY));
+    setup.u0 = (unsigned short) ((v0.u + offset(UX, UY)) & 0xfff);
+    setup.v0 = (unsigned short) ((v0.v + offset(VX, VY)) & 0xfff);
+    depth_range_clamp(setup);
+}
+
+// pixels whose center lies in [lo, hi] (sub-pixel), clipped to [scissor_min, scissor_max).
+template<int FRAC_BITS>
+static inline void pixel_range(long long lo, long long hi, int scissor_min, int scissor_max, short &first, short &end) {
+    const long long one = 1LL << FRAC_BITS, half = one >> 1;
+    first = (short) max((lo - half + one - 1) >> FRAC_BITS, (long long) scissor_min);
+    end = (short) min(((hi - half) >> FRAC_BITS) + 1, (long long) scissor_max);
+}
+
+// the setup of triangle (v0, v1, v2), e01 / e12 / e20 being the edges between them.
+template<int INT_BITS, int FRAC_BITS>
+static bool fixed_setup(const FixedVertex &v0, const FixedVertex &v1, const FixedVertex &v2,
+                        const FixedEdge &e01, const FixedEdge &e12, const FixedEdge &e20,
+                        const Rect &scissor, TriangleSetup &setup) {
+    // pixels whose center lies in the box, clipped to the scissor rectangle.
+    pixel_range<FRAC_BITS>(min(v0.x, min(v1.x, v2.x)), max(v0.x, max(v1.x, v2.x)), scissor.min_x, scissor.max_x,
+                           setup.min_x, setup.max_x);
+    pixel_range<FRAC_BITS>(min(v0.y, min(v1.y, v2.y)), max(v0.y, max(v1.y, v2.y)), scissor.min_y, scissor.max_y,
+                           setup.min_y, setup.max_y);
+    if (setup.min_x >= setup.max_x || setup.min_y >= setup.max_y) return false;
+
+    long long delta = e01.F_0 + e12.F_0 + e20.F_0;
+    if (delta <= 0) return false;
+    fixed_planes<INT_BITS, FRAC_BITS>(v0, v1, v2, e01, e12, e20, delta, 1.0 / (double) delta, setup);
+    return true;
+}
+
+template<int INT_BITS, int FRAC_BITS>
+bool triangle_setup(const Vertex input[3], const Rect &scissor, TriangleSetup &setup) {
+    // the edge steps are differences of two coordinates, 8 of them must fit the 32 bit
+    // block local edge values the raster kernels work on.
+    static_assert(INT_BITS + FRAC_BITS <= 24, "fixed-point format too wide");
+    // input here should be in screen space, pixel (x, y) is sampled at its center.
+    FixedVertex v[3];
+    for (int i = 0; i < 3; i++) {
+        if (!fixed_vertex<INT_BITS, FRAC_BITS>(input[i], v[i])) return false;
+    }
+    return fixed_setup<INT_BITS, FRAC_BITS>(v[0], v[1], v[2], fixed_edge(v[0], v[1]), fixed_edge(v[1], v[2]),
+                                            fixed_edge(v[2], v[0]), scissor, setup);
+}
+
+// vertex i of the fan of polygon[0, n), taken the other way around when reversed.
+static inline int fan_vertex(int i, int n, bool reversed) {
+    return reversed && i ? n - i : i;
+}
+
+// the fan of triangle_fan_setup(), every vertex converted once. triangle i ends in the edge from
+// vertex i back to vertex 0, the next one starts with the same edge the other way round.
+template<int INT_BITS, int FRAC_BITS>
+static int fixed_fan_setup(const ClipPolygon &polygon, int n, bool reversed, const Rect &scissor,
+                           TriangleSetup setups[]) {
+    if (n < 3) return 0;
+    FixedVertex v[FAN_MAX_VERTICES];
+    bool valid[FAN_MAX_VERTICES];
+    for (int i = 0; i < n; i++) {
+        int j = fan_vertex(i, n, reversed);
+        valid[i] = fixed_vertex<INT_BITS, FRAC_BITS>(polygon.x[j], polygon.y[j], polygon.z[j], polygon.u[j],
+                                                     polygon.v[j], v[i]);
+    }
+    int count = 0;
+    FixedEdge spoke = fixed_edge(v[0], v[1]);
+    for (int i = 2; i < n; i++) {
+        FixedEdge next = fixed_edge(v[0], v[i]);
+        if (valid[0] && valid[i - 1] && valid[i] &&
+            fixed_setup<INT_BITS, FRAC_BITS>(v[0], v[i - 1], v[i], spoke, fixed_edge(v[i - 1], v[i]), negate(next),
+                                             scissor, setups[count])) {
+            count++;
         }
-        F01_y = (F01_y + ext12b(DF01DY)) & 0xffffff;
-        F12_y = (F12_y + ext12b(DF12DY)) & 0xffffff;
-        F20_y = (F20_y + ext12b(DF20DY)) & 0xffffff;
-        Z_y = (unsigned short) (Z_y + DZDY);
-        U_y = (short) ((U_y + ext12b(DUDY)) & 0xfff);
-        V_y = (short) ((V_y + ext12b(DVDY)) & 0xfff);
+        spoke = next;
+    }
+    return count;
+}
+
+int triangle_fan_setup(TriangleSetupFunc func, const ClipPolygon &polygon, int n, bool reversed,
+                       const Rect &scissor, TriangleSetup setups[]) {
+    if (func == triangle_setup<12, 4>) return fixed_fan_setup<12, 4>(polygon, n, reversed, scissor, setups);
+    if (func == triangle_setup<16, 8>) return fixed_fan_setup<16, 8>(polygon, n, reversed, scissor, setups);
+    // the 12.0 edges live in a ring, they are set up triangle by triangle.
+    int count = 0;
+    for (int i = 2; i < n; i++) {
+        Vertex triangle[3] = {polygon_vertex(polygon, 0), polygon_vertex(polygon, fan_vertex(i - 1, n, reversed)),
+                              polygon_vertex(polygon, fan_vertex(i, n, reversed))};
+        if (func(triangle, scissor, setups[count])) count++;
     }
+    return count;
+}
+
+int triangle_fan_setup(TriangleSetupFunc func, const Vertex polygon[], int n, const Rect &scissor,
+                       TriangleSetup setups[]) {
+    ClipPolygon lanes;
+    for (int i = 0; i < n; i++) polygon_store(lanes, i, polygon[i]);
+    return triangle_fan_setup(func, lanes, n, false, scissor, setups);
+}
+
+// up to SETUP_BATCH screen space triangles snapped to INT_BITS.FRAC_BITS, lane i being triangle
+// i, with their doubled areas and boxes. lanes with a vertex out of range, and the ones past n,
+// are not valid and have all 0 positions. every valid position fits in an int, so do the boxes.
+struct FixedLanes {
+    int x[3][SETUP_BATCH], y[3][SETUP_BATCH];
+    bool valid[SETUP_BATCH];
+    long long delta[SETUP_BATCH];
+    int min_x[SETUP_BATCH], max_x[SETUP_BATCH], min_y[SETUP_BATCH], max_y[SETUP_BATCH];
+
+    // whether lane i is a valid triangle with area and a pixel center in its box, facing either way.
+    bool visible(int i) const {
+        return valid[i] && delta[i] != 0 && min_x[i] < max_x[i] && min_y[i] < max_y[i];
+    }
+};
+
+// the lanes of fx / fy, snapped all at once. past the snapping every loop runs over all of the
+// lanes without branches, in 32 bit lanes but for the areas.
+template<int INT_BITS, int FRAC_BITS>
+static FixedLanes fixed_lanes(const float fx[3][SETUP_BATCH], const float fy[3][SETUP_BATCH], int n,
+                              const Rect &scissor) {
+    FixedLanes lanes;
+    const int one = 1 << FRAC_BITS, half = one >> 1;
+    int sx[3][SETUP_BATCH], sy[3][SETUP_BATCH];
+    for (int k = 0; k < 3; k++) {
+        snap_lanes(fx[k], (float) one, sx[k]);
+        snap_lanes(fy[k], (float) one, sy[k]);
+    }
+    // all ones where valid.
+    const int limit = 1 << (INT_BITS + FRAC_BITS - 1);
+    int valid[SETUP_BATCH];
+    for (int i = 0; i < SETUP_BATCH; i++) valid[i] = -(int) (i < n);
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < SETUP_BATCH; i++) {
+            valid[i] &= -(int) ((sx[k][i] >= -limit) & (sx[k][i] < limit) & (sy[k][i] >= -limit) & (sy[k][i] < limit));
+        }
+    }
+    // out of range ones could overflow the edges, the lane is dropped anyway.
+    int (&x)[3][SETUP_BATCH] = lanes.x, (&y)[3][SETUP_BATCH] = lanes.y;
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < SETUP_BATCH; i++) {
+            x[k][i] = sx[k][i] & valid[i];
+            y[k][i] = sy[k][i] & valid[i];
+        }
+    }
+    for (int i = 0; i < SETUP_BATCH; i++) lanes.valid[i] = valid[i] != 0;
+    // the sum of the three edge functions at the origin, as one cross product.
+    for (int i = 0; i < SETUP_BATCH; i++) {
+        lanes.delta[i] = (long long) (x[1][i] - x[0][i]) * (y[2][i] - y[0][i]) -
+                         (long long) (x[2][i] - x[0][i]) * (y[1][i] - y[0][i]);
+    }
+    // pixel_range() of every lane.
+    for (int i = 0; i < SETUP_BATCH; i++) {
+        int lo_x = min(x[0][i], min(x[1][i], x[2][i])), hi_x = max(x[0][i], max(x[1][i], x[2][i]));
+        int lo_y = min(y[0][i], min(y[1][i], y[2][i])), hi_y = max(y[0][i], max(y[1][i], y[2][i]));
+        lanes.min_x[i] = max((lo_x - half + one - 1) >> FRAC_BITS, scissor.min_x);
+        lanes.max_x[i] = min(((hi_x - half) >> FRAC_BITS) + 1, scissor.max_x);
+        lanes.min_y[i] = max((lo_y - half + one - 1) >> FRAC_BITS, scissor.min_y);
+        lanes.max_y[i] = min(((hi_y - half) >> FRAC_BITS) + 1, scissor.max_y);
+    }
+    return lanes;
+}
+
+// triangle_setup<INT_BITS, FRAC_BITS> of up to SETUP_BATCH triangles of stream, lane i being
+// vertices indices[3 * i, 3 * i + 3) at (x[k][i], y[k][i]): fixed_lanes(), the edges of all the
+// lanes, then the records of the lanes left.
+template<int INT_BITS, int FRAC_BITS>
+static int fixed_setup_batch(const VertexStream &stream, const unsigned int indices[], const float x[3][SETUP_BATCH],
+                             const float y[3][SETUP_BATCH], int n, const Rect &scissor, TriangleSetup setups[]) {
+    FixedLanes lanes = fixed_lanes<INT_BITS, FRAC_BITS>(x, y, n, scissor);
+    // edge k runs from vertex k to vertex k + 1.
+    long long F_0[3][SETUP_BATCH], DX[3][SETUP_BATCH], DY[3][SETUP_BATCH];
+    for (int k = 0; k < 3; k++) {
+        const int *ax = lanes.x[k], *ay = lanes.y[k], *bx = lanes.x[(k + 1) % 3], *by = lanes.y[(k + 1) % 3];
+        for (int i = 0; i < SETUP_BATCH; i++) {
+            F_0[k][i] = (long long) ax[i] * by[i] - (long long) bx[i] * ay[i];
+            DX[k][i] = ay[i] - by[i];
+            DY[k][i] = bx[i] - ax[i];
+        }
+    }
+    // depth and texcoords straight from the stream.
+    alignas(32) float fz[3][SETUP_BATCH] = {};
+    unsigned short u[3][SETUP_BATCH], v[3][SETUP_BATCH];
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            const VertexBatch &batch = stream[indices[3 * i + k] / VERTEX_BATCH];
+            unsigned int j = indices[3 * i + k] % VERTEX_BATCH;
+            fz[k][i] = batch.z[j];
+            u[k][i] = (unsigned short) (batch.u[j] * 4095.f);
+            v[k][i] = (unsigned short) (batch.v[j] * 4095.f);
+        }
+    }
+    int sz[3][SETUP_BATCH];
+    for (int k = 0; k < 3; k++) snap_lanes(fz[k], 65535.f, sz[k]);
+    double r[SETUP_BATCH];
+    for (int i = 0; i < SETUP_BATCH; i++) {
+        // one reciprocal per triangle for all of its divisions.
+        r[i] = 1.0 / (double) (lanes.delta[i] > 0 ? lanes.delta[i] : 1);
+    }
+
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (!lanes.visible(i) || lanes.delta[i] < 0) continue;
+        FixedVertex fv[3];
+        for (int k = 0; k < 3; k++) {
+            fv[k].x = lanes.x[k][i];
+            fv[k].y = lanes.y[k][i];
+            fv[k].d = (unsigned short) sz[k][i];
+            fv[k].u = u[k][i];
+            fv[k].v = v[k][i];
+        }
+        FixedEdge e[3];
+        for (int k = 0; k < 3; k++) e[k] = FixedEdge{F_0[k][i], DX[k][i], DY[k][i]};
+        TriangleSetup &setup = setups[count++];
+        setup.min_x = (short) lanes.min_x[i];
+        setup.max_x = (short) lanes.max_x[i];
+        setup.min_y = (short) lanes.min_y[i];
+        setup.max_y = (short) lanes.max_y[i];
+        fixed_planes<INT_BITS, FRAC_BITS>(fv[0], fv[1], fv[2], e[0], e[1], e[2], lanes.delta[i], r[i], setup);
+    }
+    return count;
+}
+
+int triangle_setup_batch(TriangleSetupFunc func, const VertexStream &stream, const unsigned int indices[],
+                         const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n, const Rect &scissor,
+                         TriangleSetup setups[]) {
+    if (func == triangle_setup<12, 4>) return fixed_setup_batch<12, 4>(stream, indices, x, y, n, scissor, setups);
+    if (func == triangle_setup<16, 8>) return fixed_setup_batch<16, 8>(stream, indices, x, y, n, scissor, setups);
+    // the others take a triangle of vertices.
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        Vertex triangle[3] = {stream_vertex(stream, indices[3 * i]), stream_vertex(stream, indices[3 * i + 1]),
+                              stream_vertex(stream, indices[3 * i + 2])};
+        if (func(triangle, scissor, setups[count])) count++;
+    }
+    return count;
+}
+
+template<int INT_BITS, int FRAC_BITS>
+static void fixed_cull(const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n, const Rect &scissor,
+                       unsigned int windings, unsigned int out[SETUP_BATCH]) {
+    FixedLanes lanes = fixed_lanes<INT_BITS, FRAC_BITS>(x, y, n, scissor);
+    for (int i = 0; i < n; i++) {
+        unsigned int winding = lanes.delta[i] > 0 ? WINDING_CCW : WINDING_CW;
+        out[i] = lanes.visible(i) ? winding & windings : 0;
+    }
+}
+
+// triangle_cull() for the 12.0 triangle_setup: snapped as it does, the box clipped to the
+// scissor, and the doubled area in its 24 bit ring, where the other winding negates it.
+static void integer_cull(const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n, const Rect &scissor,
+                         unsigned int windings, unsigned int out[SETUP_BATCH]) {
+    for (int i = 0; i < n; i++) {
+        int sx[3], sy[3];
+        for (int k = 0; k < 3; k++) {
+            sx[k] = (int) (lroundf(x[k][i]) & 0xfff);
+            sy[k] = (int) (lroundf(y[k][i]) & 0xfff);
+        }
+        bool boxed = max(min(sx[0], min(sx[1], sx[2])), scissor.min_x) <
+                     min(max(sx[0], max(sx[1], sx[2])), scissor.max_x) &&
+                     max(min(sy[0], min(sy[1], sy[2])), scissor.min_y) <
+                     min(max(sy[0], max(sy[1], sy[2])), scissor.max_y);
+        int delta = ((sx[0] * sy[1] - sx[1] * sy[0]) + (sx[1] * sy[2] - sx[2] * sy[1]) +
+                     (sx[2] * sy[0] - sx[0] * sy[2])) & 0xffffff;
+        int reversed = -delta & 0xffffff;
+        unsigned int winding = 0;
+        if (delta != 0 && !(delta & 0x800000)) winding |= WINDING_CCW;
+        if (reversed != 0 && !(reversed & 0x800000)) winding |= WINDING_CW;
+        out[i] = boxed ? winding & windings : 0;
+    }
+}
+
+void triangle_cull(TriangleSetupFunc func, const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n,
+                   const Rect &scissor, unsigned int windings, unsigned int out[SETUP_BATCH]) {
+    if (func == static_cast<TriangleSetupFunc>(triangle_setup)) return integer_cull(x, y, n, scissor, windings, out);
+    if (func == triangle_setup<12, 4>) return fixed_cull<12, 4>(x, y, n, scissor, windings, out);
+    if (func == triangle_setup<16, 8>) return fixed_cull<16, 8>(x, y, n, scissor, windings, out);
+    for (int i = 0; i < n; i++) out[i] = windings;
+}
+
+// x clamped to +-2^60, far beyond anything on the screen, so it converts to long long.
+static double clamp60(double x) {
+    const double limit = 1152921504606846976.0;
+    return x < -limit ? -limit : (x > limit ? limit : x);
+}
+
+bool triangle_setup_homogeneous(const Vertex input[3], const Rect &scissor, TriangleSetup &setup) {
+    // input here should be in homogeneous screen space, pixel (x, y) is sampled at its center.
+    // edge ij is det(V_i, V_j, p) of the homogeneous points V = (X, Y, W) and p = (x, y, 1).
+    // it is the screen space edge function times W_i * W_j, and the triangle covers the pixels
+    // where all three are >= 0 and its determinant is > 0. points behind the eye have them of
+    // mixed sign or all < 0, so nothing has to be clipped.
+    double X[3], Y[3], W[3];
+    for (int i = 0; i < 3; i++) {
+        X[i] = input[i].position[0];
+        Y[i] = input[i].position[1];
+        W[i] = input[i].position[3];
+    }
+    // edges 01, 12, 20: a * x + b * y + c. products of floats are exact in double, so the
+    // edge of a neighbour sharing the two vertices the other way round is exactly the negation.
+    double a[3], b[3], c[3];
+    for (int e = 0; e < 3; e++) {
+        int i = e, j = (e + 1) % 3;
+        a[e] = Y[i] * W[j] - Y[j] * W[i];
+        b[e] = W[i] * X[j] - W[j] * X[i];
+        c[e] = X[i] * Y[j] - X[j] * Y[i];
+    }
+    double det = a[0] * X[2] + b[0] * Y[2] + c[0] * W[2];
+    // back facing, zero area or not a number.
+    if (!(det > 0)) return false;
+
+    // the box of the projected vertices when they are all in front of the eye, the whole
+    // scissor otherwise.
+    double box_min_x = scissor.min_x, box_max_x = scissor.max_x;
+    double box_min_y = scissor.min_y, box_max_y = scissor.max_y;
+    if (W[0] > 0 && W[1] > 0 && W[2] > 0) {
+        double px[3] = {X[0] / W[0], X[1] / W[1], X[2] / W[2]};
+        double py[3] = {Y[0] / W[0], Y[1] / W[1], Y[2] / W[2]};
+        box_min_x = max(box_min_x, std::floor(min(px[0], min(px[1], px[2]))));
+        box_max_x = min(box_max_x, std::ceil(max(px[0], max(px[1], px[2]))));
+        box_min_y = max(box_min_y, std::floor(min(py[0], min(py[1], py[2]))));
+        box_max_y = min(box_max_y, std::ceil(max(py[0], max(py[1], py[2]))));
+    }
+    if (!(box_min_x < box_max_x && box_min_y < box_max_y)) return false;
+    setup.min_x = (short) box_min_x;
+    setup.max_x = (short) box_max_x;
+    setup.min_y = (short) box_min_y;
+    setup.max_y = (short) box_max_y;
+
+    // an edge only has to keep its sign: scale it to steps of 21 bits, which keeps it within
+    // 1 / 1000 of a pixel over the screen, and round. the rest is the top-left fill rule as in
+    // the sub-pixel setup, with the function at pixel centers, x + 0.5 and y + 0.5.
+    long long F_0[3];
+    int DX[3], DY[3];
+    for (int e = 0; e < 3; e++) {
+        double m = max(std::fabs(a[e]), std::fabs(b[e]));
+        if (m == 0) {
+            // the edge is the line at infinity, on one side of it all along.
+            DX[e] = DY[e] = 0;
+            F_0[e] = c[e] > 0 ? 0 : -1;
+            continue;
+        }
+        int exponent;
+        std::frexp(m, &exponent);
+        double scale = std::ldexp(1.0, 21 - exponent);
+        DX[e] = (int) std::llround(a[e] * scale);
+        DY[e] = (int) std::llround(b[e] * scale);
+        double C = clamp60(c[e] * scale + (DX[e] + DY[e]) * 0.5);
+        bool top_left = DX[e] > 0 || (DX[e] == 0 && DY[e] > 0);
+        F_0[e] = top_left ? (long long) std::floor(C) : (long long) std::ceil(C) - 1;
+    }
+    setup.F01_0 = F_0[0];
+    setup.F12_0 = F_0[1];
+    setup.F20_0 = F_0[2];
+    setup.DF01DX = DX[0];
+    setup.DF12DX = DX[1];
+    setup.DF20DX = DX[2];
+    setup.DF01DY = DY[0];
+    setup.DF12DY = DY[1];
+    setup.DF20DY = DY[2];
+    setup.edge_bits = 64;
+    setup.depth_clip = true;
+    setup.depth_clamp = false;
+
+    // vertex i weighs E_jk / det (E_jk being the edge across from it), which sums Z to the
+    // depth plane and, W times the texcoords, to the screen space affine texcoords the other
+    // setups interpolate. all of them are planes, across w = 0 too.
+    double q[3][3];
+    for (int i = 0; i < 3; i++) {
+        q[0][i] = input[i].position[2] * 65535.0;
+        q[1][i] = input[i].texcoord[0] * 4095.0 * W[i];
+        q[2][i] = input[i].texcoord[1] * 4095.0 * W[i];
+    }
+    // the planes start at the middle of the box, to halve the rounded steps walked off it.
+    setup.x0 = (short) ((setup.min_x + setup.max_x) / 2);
+    setup.y0 = (short) ((setup.min_y + setup.max_y) / 2);
+    double cx = setup.x0 + 0.5, cy = setup.y0 + 0.5;
+    long long value[3], step_x[3], step_y[3];
+    for (int k = 0; k < 3; k++) {
+        double qa = q[k][0] * a[1] + q[k][1] * a[2] + q[k][2] * a[0];
+        double qb = q[k][0] * b[1] + q[k][1] * b[2] + q[k][2] * b[0];
+        double qc = q[k][0] * c[1] + q[k][1] * c[2] + q[k][2] * c[0];
+        value[k] = std::llround(clamp60((qa * cx + qb * cy + qc) / det));
+        step_x[k] = std::llround(clamp60(qa / det));
+        step_y[k] = std::llround(clamp60(qb / det));
+    }
+    // depth stays unwrapped for the cut, within what the raster loops step over a screen.
+    setup.d0 = depth_start(value[0]);
+    setup.DZDX = depth_step(step_x[0]);
+    setup.DZDY = depth_step(step_y[0]);
+    setup.u0 = (unsigned short) (value[1] & 0xfff);
+    setup.v0 = (unsigned short) (value[2] & 0xfff);
+    setup.DUDX = ext12b((short) (step_x[1] & 0xfff));
+    setup.DUDY = ext12b((short) (step_y[1] & 0xfff));
+    setup.DVDX = ext12b((short) (step_x[2] & 0xfff));
+    setup.DVDY = ext12b((short) (step_y[2] & 0xfff));
+    return true;
+}
+
+template bool triangle_setup<12, 4>(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+template bool triangle_setup<16, 8>(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+// visibility pass: the triangle's id instead of a colour.
+struct IdShader {
+    static constexpr bool discards = false;
+
+    bool shade(const Fragment &, unsigned int &color) const {
+        color = id;
+        return true;
+    }
+
+#if defined(__SSE2__)
+
+    __m128i shade(const Fragment4 &, __m128i &color) const {
+        color = _mm_set1_epi32((int) id);
+        return _mm_set1_epi32(-1);
+    }
+
+#endif
+
+#if defined(__AVX2__)
+
+    __m256i shade(const Fragment8 &, __m256i &color) const {
+        color = _mm256_set1_epi32((int) id);
+        return _mm256_set1_epi32(-1);
+    }
+
+#endif
+
+    unsigned int id;
+};
+
+template<class State>
+static void raster_visibility(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target,
+                              unsigned int id) {
+    raster_blocks<State>(setup, rect, target, IdShader{id});
+}
+
+RasterFunc select_raster(const RasterState &state) {
+    return select_raster<TextureShader>(state);
+}
+
+// the visibility loops only depend on the depth state and whether the id is written.
+static const int VISIBILITY_STATE_COUNT = (DEPTH_ALWAYS + 1) * 2 * 2;
+
+template<int I>
+using VisibilityStateOf = StaticRasterState<(DepthFunc) (I / 4), (I / 2) % 2 != 0, I % 2 != 0, BLEND_NONE>;
+
+template<int... I>
+static constexpr std::array<VisibilityFunc, sizeof...(I)> make_visibility_table(std::integer_sequence<int, I...>) {
+    return {{&raster_visibility<VisibilityStateOf<I>>...}};
+}
+
+static constexpr auto visibility_table = make_visibility_table(
+        std::make_integer_sequence<int, VISIBILITY_STATE_COUNT>());
+
+VisibilityFunc select_visibility(const RasterState &state) {
+    if (!state.depth_test) return visibility_table[(DEPTH_ALWAYS * 2 + 0) * 2 + state.color_write];
+    return visibility_table[(state.depth_func * 2 + state.depth_write) * 2 + state.color_write];
+}
+
+void shade_span(const TriangleSetup &setup, int x, int y, int n, const void *uniforms, unsigned int *fb) {
+    shade_span<TextureShader>(setup, x, y, n, uniforms, fb);
+}
+
+void triangle_raster(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target, const void *uniforms) {
+    raster_triangle<StaticRasterState<DEPTH_GEQUAL, true, true, BLEND_NONE>, TextureShader>(setup, rect, target, uniforms);
+}
+
+void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const Texture *tex,
+                           unsigned short *db, unsigned int *fb, const Rect &scissor) {
+    TriangleSetup setup{};
+    Rect viewport{0, 0, (int) width, (int) height};
+    if (!triangle_setup(input, rect_intersect(scissor, viewport), setup)) return;
+    Rect rect{setup.min_x, setup.min_y, setup.max_x, setup.max_y};
+    RenderTarget target{fb, db, width, nullptr};
+    triangle_raster(setup, rect, target, tex);
+}
+
+void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const Texture *tex,
+                           unsigned short *db, unsigned int *fb) {
+    half_space_rasterizer(input, width, height, tex, db, fb, Rect{0, 0, (int) width, (int) height});
 }
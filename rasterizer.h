@@ -0,0 +1,167 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_RASTERIZER_H
+#define SIMPLE_SOFT_RASTERIZER_RASTERIZER_H
+
+#include "vertex.h"
+#include "vertex_stage.h"
+#include "primitive.h"
+
+class Texture;
+
+void vertex_transform(const glm::mat4 &transMatrix, const Vertex &in, Vertex &out);
+
+// clip_outcode() bits: the planes triangle_clip() clips to, near, far, left, right, top, bottom,
+// then the left, right, top, bottom sides of a guard band.
+static const unsigned int CLIP_NEAR = 1u << 0;
+static const unsigned int CLIP_FAR = 1u << 1;
+static const unsigned int CLIP_VIEW = 0x3fu;
+static const unsigned int CLIP_GUARD = 0xfu << 6;
+
+// bit i set where p is outside of clip plane i.
+unsigned int clip_outcode(const glm::vec4 &p);
+
+// same, plus the CLIP_GUARD bits of the band |x| <= guard_x * w, |y| <= guard_y * w.
+unsigned int clip_outcode(const glm::vec4 &p, float guard_x, float guard_y);
+
+// a triangle clipped to the six planes gains at most one vertex per plane.
+static const int FAN_MAX_VERTICES = 9;
+
+// a convex polygon as structure of arrays, vertex i being lane i of every array: the clipper's
+// buffers, from the vertex stream through projection to the fan setup.
+struct ClipPolygon {
+    float x[FAN_MAX_VERTICES], y[FAN_MAX_VERTICES], z[FAN_MAX_VERTICES], w[FAN_MAX_VERTICES];
+    float u[FAN_MAX_VERTICES], v[FAN_MAX_VERTICES];
+};
+
+// clip a triangle to the view volume, output gets the convex polygon left (up to
+// FAN_MAX_VERTICES) and its vertex count is returned. triangles inside every plane come back
+// untouched.
+int triangle_clip(const Vertex input[3], Vertex output[]);
+
+// same, with the clip_outcode() of the input vertices already at hand. only the planes of the
+// CLIP_VIEW bits set in codes are clipped to.
+int triangle_clip(const Vertex input[3], const unsigned int codes[3], Vertex output[]);
+
+// same, for the triangle of vertices indices[0, 3) of stream, output being clipped in place.
+int triangle_clip(const VertexStream &stream, const unsigned int indices[3], const unsigned int codes[3],
+                  ClipPolygon &output);
+
+void perspective_division(const Vertex &input, Vertex &output);
+
+void screen_transform(const Vertex &input, Vertex &out, float width, float height);
+
+// perspective_division() and screen_transform() of polygon[0, n), in place.
+void polygon_screen_transform(ClipPolygon &polygon, int n, float width, float height);
+
+// clip space to homogeneous screen space: (x, y, z, w) whose perspective division is
+// screen_transform() of the NDC, for triangle_setup_homogeneous().
+void homogeneous_screen_transform(const Vertex &input, Vertex &out, float width, float height);
+
+// return false when the triangle is rejected (back facing, zero area or outside the scissor).
+// the bounding box of the setup is clipped to the scissor rectangle.
+// vertices are snapped to whole pixels (unsigned 12.0).
+bool triangle_setup(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+// same, with vertices snapped to signed INT_BITS.FRAC_BITS, pixels sampled at their centers and
+// a top-left fill rule. triangles reaching outside the representable range are rejected.
+// instantiated for 12.4 and 16.8.
+template<int INT_BITS, int FRAC_BITS>
+bool triangle_setup(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+// screen space x / y (less a pixel for rounding) triangle_setup<INT_BITS, FRAC_BITS> takes
+// either way from 0, which makes the guard band triangles reaching past the viewport need not
+// be clipped against.
+template<int INT_BITS, int FRAC_BITS>
+constexpr float setup_range() {
+    return (float) ((1 << (INT_BITS - 1)) - 1);
+}
+
+// same, with input in homogeneous screen space and not clipped at all. the edge functions come
+// straight from the 2D homogeneous coordinates (Olano and Greer), so triangles crossing w = 0
+// set up like any other, and the near / far planes are left to depth_clip. edges are kept to
+// about 1 / 1000 of a pixel, texcoords are screen space affine like the other setups'.
+bool triangle_setup_homogeneous(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+using TriangleSetupFunc = bool (*)(const Vertex input[3], const Rect &scissor, TriangleSetup &setup);
+
+// set up the fan (polygon[0], polygon[i - 1], polygon[i]), i in [2, n), of a convex polygon in
+// screen space with func, e.g. the output of triangle_clip(). setups gets the triangles not
+// rejected, up to n - 2, and their count is returned. the sub-pixel setups convert every
+// vertex once and share the edge between neighbouring triangles, the result being the same as
+// setting up each triangle on its own.
+int triangle_fan_setup(TriangleSetupFunc func, const Vertex polygon[], int n, const Rect &scissor,
+                       TriangleSetup setups[]);
+
+// same, with the polygon as structure of arrays. reversed sets up the fan of its vertices the
+// other way around, polygon[0] then polygon[n - 1] down to polygon[1].
+int triangle_fan_setup(TriangleSetupFunc func, const ClipPolygon &polygon, int n, bool reversed,
+                       const Rect &scissor, TriangleSetup setups[]);
+
+// triangles triangle_setup_batch() sets up side by side.
+static const int SETUP_BATCH = 8;
+
+// set up the n (up to SETUP_BATCH) triangles of stream in screen space with func, triangle i
+// being vertices indices[3 * i, 3 * i + 3) and its positions already gathered into lane i of x / y
+// as triangle_cull() takes them. setups gets the triangles not rejected, in order, and their
+// count is returned. the sub-pixel setups work on the lanes side by side, taking depth and
+// texcoords straight from stream, and divide by one reciprocal of the area per triangle, the
+// result being the same as setting up each triangle on its own.
+int triangle_setup_batch(TriangleSetupFunc func, const VertexStream &stream, const unsigned int indices[],
+                         const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n, const Rect &scissor,
+                         TriangleSetup setups[]);
+
+// windings of a screen space triangle: counterclockwise (x right, y up as NDC), the one every
+// setup takes, or clockwise.
+static const unsigned int WINDING_CCW = 1u << 0;
+static const unsigned int WINDING_CW = 1u << 1;
+
+// cull stage: SETUP_BATCH triangles in screen space, lane i being (x[k][i], y[k][i]), k in
+// [0, 3), before any setup. out[i] gets the windings of windings triangle i is to be drawn with,
+// 0 when it is culled. the 12.0 and sub-pixel setups are exact: triangles func would reject as
+// out of range, zero area or covering no pixel inside the scissor are culled, the others get
+// their own winding if drawn. any other func gets windings, leaving the rest to the setup.
+void triangle_cull(TriangleSetupFunc func, const float x[3][SETUP_BATCH], const float y[3][SETUP_BATCH], int n,
+                   const Rect &scissor, unsigned int windings, unsigned int out[SETUP_BATCH]);
+
+// rasterize the part of the triangle inside rect, pixel (x, y) lives at target[y * stride + x].
+// uniforms go to the fragment shader the function was compiled for, see shader.h.
+using RasterFunc = void (*)(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target,
+                            const void *uniforms);
+
+// the raster loop compiled for state, so it carries no state checks per pixel. it shades with
+// TextureShader, uniforms being the const Texture * (or nullptr for the u / v colour).
+RasterFunc select_raster(const RasterState &state);
+
+// visibility pass: rasterize depth as the RasterFunc of a state does, but write id instead of a
+// colour to target.fb (blending is ignored), so the pixel can be shaded once by shade_span later.
+using VisibilityFunc = void (*)(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target,
+                                unsigned int id);
+
+VisibilityFunc select_visibility(const RasterState &state);
+
+// shading pass: shade pixels [x, x + n) of row y from the attribute planes of setup into fb[0, n).
+using ShadeFunc = void (*)(const TriangleSetup &setup, int x, int y, int n, const void *uniforms, unsigned int *fb);
+
+// with TextureShader.
+void shade_span(const TriangleSetup &setup, int x, int y, int n, const void *uniforms, unsigned int *fb);
+
+// a fragment shader compiled into the raster and shading loops, see fragment_program() in
+// raster_loop.h. uniforms is what its triangles are shaded with.
+struct FragmentProgram {
+    RasterFunc (*select)(const RasterState &state);
+    ShadeFunc shade;
+    const void *uniforms;
+    // Shader::discards, which pixels its triangles cover is only known once shaded.
+    bool discards;
+};
+
+// same as select_raster(RasterState{}).
+void triangle_raster(const TriangleSetup &setup, const Rect &rect, const RenderTarget &target, const void *uniforms);
+
+// only pixels inside both the scissor rectangle and the width x height viewport are touched.
+void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const Texture *tex,
+                           unsigned short *db, unsigned int *fb, const Rect &scissor);
+
+void half_space_rasterizer(const Vertex input[3], unsigned int width, unsigned int height, const Texture *tex,
+                           unsigned short *db, unsigned int *fb);
+
+#endif //SIMPLE_SOFT_RASTERIZER_RASTERIZER_H
@@ -0,0 +1,124 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_SHADER_H
+#define SIMPLE_SOFT_RASTERIZER_SHADER_H
+
+#include "primitive.h"
+#include "texture.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// a fragment shader is a class the raster loops are compiled for (see raster_loop.h), so it is
+// called without any indirection and inlined into them:
+//
+//   struct MyShader {
+//       // what a draw hands its triangles, by pointer.
+//       using Uniforms = ...;
+//       // whether shade() ever returns false / a lane not all ones.
+//       static constexpr bool discards = false;
+//       // once per triangle and tile.
+//       MyShader(const Uniforms *uniforms, const TriangleSetup &setup);
+//       // colour of one pixel, false to leave the pixel (colour and depth) alone.
+//       bool shade(const Fragment &in, unsigned int &color) const;
+//       // optional, 4 / 8 pixels at once, return all ones in the lanes kept. without these the
+//       // raster loops call the scalar one lane by lane.
+//       __m128i shade(const Fragment4 &in, __m128i &color) const;
+//       __m256i shade(const Fragment8 &in, __m256i &color) const;
+//   };
+//
+// depth is tested before shading and comes from the triangle's plane, a shader cannot change it.
+
+// varyings of pixel (x, y), in the fixed point of TriangleSetup: z is 16 bit, u / v are 12 bit
+// fractions of the texture.
+struct Fragment {
+    int x, y;
+    int z, u, v;
+};
+
+#if defined(__SSE2__)
+
+// pixels (x + i, y), lane i.
+struct Fragment4 {
+    int x, y;
+    __m128i z, u, v;
+};
+
+#endif
+
+#if defined(__AVX2__)
+
+struct Fragment8 {
+    int x, y;
+    __m256i z, u, v;
+};
+
+#endif
+
+static inline unsigned int uv_color(int u, int v) {
+    return 0xff000000 | (((u >> 4) & 0xff) << 8) | (((v >> 4) & 0xff) << 0);
+}
+
+// the built-in material: texels of the texture at (u, v), or u / v as green / blue without one.
+struct TextureShader {
+    using Uniforms = Texture;
+    static constexpr bool discards = false;
+
+    // u, v are affine over the triangle, one level of detail fits all of its pixels.
+    TextureShader(const Texture *tex, const TriangleSetup &setup) :
+            tex(tex), lod(tex ? tex->lod(setup.DUDX, setup.DUDY, setup.DVDX, setup.DVDY) : 0) {}
+
+    bool shade(const Fragment &in, unsigned int &color) const {
+        if (tex) tex->sample(*tex, lod, &in.u, &in.v, &color, 1);
+        else color = uv_color(in.u, in.v);
+        return true;
+    }
+
+#if defined(__SSE2__)
+
+    __m128i shade(const Fragment4 &in, __m128i &color) const {
+        if (tex) {
+            alignas(16) int u[4], v[4];
+            alignas(16) unsigned int texel[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(u), in.u);
+            _mm_store_si128(reinterpret_cast<__m128i *>(v), in.v);
+            tex->sample(*tex, lod, u, v, texel, 4);
+            color = _mm_load_si128(reinterpret_cast<const __m128i *>(texel));
+        } else {
+            __m128i byte = _mm_set1_epi32(0xff);
+            color = _mm_or_si128(
+                    _mm_or_si128(_mm_set1_epi32((int) 0xff000000),
+                                 _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(in.u, 4), byte), 8)),
+                    _mm_and_si128(_mm_srli_epi32(in.v, 4), byte));
+        }
+        return _mm_set1_epi32(-1);
+    }
+
+#endif
+
+#if defined(__AVX2__)
+
+    __m256i shade(const Fragment8 &in, __m256i &color) const {
+        if (tex) {
+            alignas(32) int u[8], v[8];
+            alignas(32) unsigned int texel[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(u), in.u);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(v), in.v);
+            tex->sample(*tex, lod, u, v, texel, 8);
+            color = _mm256_load_si256(reinterpret_cast<const __m256i *>(texel));
+        } else {
+            __m256i byte = _mm256_set1_epi32(0xff);
+            color = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_set1_epi32((int) 0xff000000),
+                                    _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(in.u, 4), byte), 8)),
+                    _mm256_and_si256(_mm256_srli_epi32(in.v, 4), byte));
+        }
+        return _mm256_set1_epi32(-1);
+    }
+
+#endif
+
+    const Texture *tex;
+    int lod;
+};
+
+#endif //SIMPLE_SOFT_RASTERIZER_SHADER_H
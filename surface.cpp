@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cstring>
+
+#include "surface.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// one BLOCK_SIZE pixel row of a block.
+static inline void copy_block_row(const unsigned int *src, unsigned int *dst) {
+#if defined(__AVX2__)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+#elif defined(__SSE2__)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4)));
+#else
+    memcpy(dst, src, BLOCK_SIZE * sizeof(unsigned int));
+#endif
+}
+
+static inline void copy_block_row(const unsigned short *src, unsigned short *dst) {
+#if defined(__SSE2__)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+#else
+    memcpy(dst, src, BLOCK_SIZE * sizeof(unsigned short));
+#endif
+}
+
+template<class T>
+static void resolve(const T *surface, SurfaceLayout layout, unsigned int stride, unsigned int width,
+                    unsigned int height, T *linear) {
+    if (layout == SURFACE_LINEAR) {
+        for (unsigned int y = 0; y < height; y++) memcpy(linear + y * width, surface + y * stride, width * sizeof(T));
+        return;
+    }
+    // block by block, reading the surface in order.
+    for (unsigned int by = 0; by < height; by += BLOCK_SIZE) {
+        unsigned int rows = std::min((unsigned int) BLOCK_SIZE, height - by);
+        for (unsigned int bx = 0; bx < width; bx += BLOCK_SIZE) {
+            const T *src = surface + pixel_index(layout, stride, (int) bx, (int) by);
+            T *dst = linear + by * width + bx;
+            if (bx + BLOCK_SIZE <= width) {
+                for (unsigned int r = 0; r < rows; r++) copy_block_row(src + r * BLOCK_SIZE, dst + r * width);
+            } else {
+                for (unsigned int r = 0; r < rows; r++) memcpy(dst + r * width, src + r * BLOCK_SIZE, (width - bx) * sizeof(T));
+            }
+        }
+    }
+}
+
+void surface_resolve(const unsigned int *surface, SurfaceLayout layout, unsigned int stride,
+                     unsigned int width, unsigned int height, unsigned int *linear) {
+    resolve(surface, layout, stride, width, height, linear);
+}
+
+void surface_resolve(const unsigned short *surface, SurfaceLayout layout, unsigned int stride,
+                     unsigned int width, unsigned int height, unsigned short *linear) {
+    resolve(surface, layout, stride, width, height, linear);
+}
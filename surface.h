@@ -0,0 +1,42 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_SURFACE_H
+#define SIMPLE_SOFT_RASTERIZER_SURFACE_H
+
+#include "primitive.h"
+
+// pixels between rows of a width pixels wide surface.
+static inline unsigned int surface_stride(unsigned int width, SurfaceLayout layout) {
+    if (layout == SURFACE_LINEAR) return width;
+    return (width + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+}
+
+// pixels to allocate for a width x height surface.
+static inline unsigned int surface_size(unsigned int width, unsigned int height, SurfaceLayout layout) {
+    if (layout == SURFACE_LINEAR) return width * height;
+    return surface_stride(width, layout) * ((height + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+}
+
+// index of pixel (x, y) in a surface. a row of blocks is BLOCK_SIZE rows of stride pixels.
+static inline unsigned int pixel_index(SurfaceLayout layout, unsigned int stride, int x, int y) {
+    if (layout == SURFACE_LINEAR) return y * stride + x;
+    return (y & ~(BLOCK_SIZE - 1)) * stride + (x & ~(BLOCK_SIZE - 1)) * BLOCK_SIZE +
+           (y & (BLOCK_SIZE - 1)) * BLOCK_SIZE + (x & (BLOCK_SIZE - 1));
+}
+
+// pointer p such that p[x] is pixel (x, y), for the x of one block row [x0, x0 + BLOCK_SIZE) and
+// of a whole row when linear.
+template<class T>
+static inline T *pixel_row(T *surface, SurfaceLayout layout, unsigned int stride, int x0, int y) {
+    x0 &= ~(BLOCK_SIZE - 1);
+    return surface + pixel_index(layout, stride, x0, y) - x0;
+}
+
+// copy a width x height surface into a linear ARGB8888 image, rows width pixels apart. this is
+// the only place a tiled color buffer needs to be linear, when it is presented or read back.
+void surface_resolve(const unsigned int *surface, SurfaceLayout layout, unsigned int stride,
+                     unsigned int width, unsigned int height, unsigned int *linear);
+
+// same for a depth buffer.
+void surface_resolve(const unsigned short *surface, SurfaceLayout layout, unsigned int stride,
+                     unsigned int width, unsigned int height, unsigned short *linear);
+
+#endif //SIMPLE_SOFT_RASTERIZER_SURFACE_H
@@ -0,0 +1,103 @@
+// triangles reaching past the far plane are clipped there, and their depth planes step a little
+// below 0 along the cut, as do the ones ending right on it, which are not clipped at all. no
+// pixel may come out with that depth wrapped to the near plane's.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "tile_renderer.h"
+
+static const int WIDTH = 320, HEIGHT = 240;
+
+// pixels with a depth past near_depth once the triangles are drawn with setup, every vertex
+// being at least 2 units away from a camera whose near plane is at 0.5.
+static int stray_pixels(TriangleSetupFunc setup, float range) {
+    TransformShader shader{glm::perspective(1.2f, 4.f / 3.f, 0.5f, 8.f)};
+    const unsigned short near_depth = 0xc000;
+    int stray = 0;
+    std::vector<unsigned int> fb(WIDTH * HEIGHT);
+    std::vector<unsigned short> db(WIDTH * HEIGHT);
+    for (int t = 0; t < 200; t++) {
+        float a = (float) t * 0.37f, b = (float) t * 0.61f;
+        Vertex vertices[3] = {
+                Vertex(glm::vec4(-3.f + sinf(a), -1.f - 0.3f * cosf(b), -2.f - (float) (t % 5), 1.f), glm::vec2(0.f)),
+                Vertex(glm::vec4(3.f + cosf(b), -1.2f + 0.2f * sinf(a), -3.f - (float) (t % 3), 1.f), glm::vec2(1.f, 0.f)),
+                Vertex(glm::vec4(0.5f * sinf(a + b), 0.8f * cosf(a), -12.f - (float) (t % 7), 1.f), glm::vec2(0.f, 1.f))};
+        // every other one ends on the far plane.
+        if (t % 2) vertices[2].position.z = -8.f;
+        unsigned int indices[3] = {0, 1, 2};
+        TileRenderer renderer(WIDTH, HEIGHT, 1);
+        renderer.set_setup(setup, range);
+        RasterState state{};
+        state.cull = CULL_NONE;
+        renderer.set_state(state);
+        renderer.clear(0, 0);
+        renderer.draw_indexed(vertices, 3, indices, 3, shader);
+        renderer.flush(nullptr, db.data(), fb.data());
+        renderer.resolve(db.data(), fb.data());
+        for (int i = 0; i < WIDTH * HEIGHT; i++) {
+            if (fb[i] && db[i] > near_depth) stray++;
+        }
+    }
+    return stray;
+}
+
+// pixels more than 1/16 of the depth range off the exact plane once a screen space sliver, whose
+// depth rises faster than 16 bits per pixel across it, is drawn with setup.
+static int sliver_pixels(TriangleSetupFunc setup, float range) {
+    // depth 0.05 + 0.6 * (x - 100.2), the two columns it covers 0.6 of the range apart.
+    Vertex vertices[3] = {Vertex(glm::vec4(100.2f, 20.f, 0.05f, 1.f), glm::vec2(0.f)),
+                          Vertex(glm::vec4(101.7f, 120.f, 0.95f, 1.f), glm::vec2(1.f, 0.f)),
+                          Vertex(glm::vec4(100.2f, 120.f, 0.05f, 1.f), glm::vec2(0.f, 1.f))};
+    std::vector<unsigned int> fb(WIDTH * HEIGHT);
+    std::vector<unsigned short> db(WIDTH * HEIGHT);
+    TileRenderer renderer(WIDTH, HEIGHT, 1);
+    renderer.set_setup(setup, range);
+    RasterState state{};
+    state.cull = CULL_NONE;
+    renderer.set_state(state);
+    renderer.clear(0, 0);
+    renderer.draw(vertices);
+    renderer.flush(nullptr, db.data(), fb.data());
+    renderer.resolve(db.data(), fb.data());
+    int off = 0;
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        if (!fb[i]) continue;
+        double z = (0.05 + 0.6 * ((double) (i % WIDTH) + 0.5 - 100.2)) * 65535.0;
+        z = z < 0.0 ? 0.0 : (z > 65535.0 ? 65535.0 : z);
+        if (std::fabs(db[i] - z) > 4096.0) off++;
+    }
+    return off;
+}
+
+int main() {
+    struct {
+        const char *name;
+        TriangleSetupFunc setup;
+        float range;
+    } cases[] = {
+            {"12.0", triangle_setup, 0.f},
+            {"12.4", triangle_setup<12, 4>, setup_range<12, 4>()},
+            {"16.8", triangle_setup<16, 8>, setup_range<16, 8>()},
+            {"16.8 clipped", triangle_setup<16, 8>, 0.f},
+    };
+    int failed = 0;
+    for (auto &c: cases) {
+        int stray = stray_pixels(c.setup, c.range);
+        if (stray) {
+            printf("%s: %d pixels with wrapped depth\n", c.name, stray);
+            failed++;
+        }
+    }
+    for (int i = 1; i < 3; i++) {
+        int off = sliver_pixels(cases[i].setup, cases[i].range);
+        if (off) {
+            printf("%s: %d sliver pixels off their depth\n", cases[i].name, off);
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
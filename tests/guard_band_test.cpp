@@ -0,0 +1,83 @@
+// triangles reaching past the sides of the viewport but inside the guard band are set up as they
+// are instead of being clipped first. they must cover the same pixels either way, but for pixel
+// centers within a sub-pixel step of an edge, where the clipped ones' new vertices on the sides
+// of the viewport snap the edge a little. their depth is not compared, the clipped ones step it
+// from those vertices.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "tile_renderer.h"
+
+static const int WIDTH = 320, HEIGHT = 240;
+
+// a clip space coordinate of a vertex at w: inside the view, past its side, or now and then far
+// past the guard band, so the triangle is clipped either way.
+static float coordinate(std::mt19937 &rng, float w) {
+    switch (rng() % 8) {
+        case 0:
+            return std::uniform_real_distribution<float>(-300.f, 300.f)(rng) * w;
+        case 1:
+        case 2:
+            return std::uniform_real_distribution<float>(-1.f, 1.f)(rng) * w;
+        default:
+            return std::uniform_real_distribution<float>(-4.f, 4.f)(rng) * w;
+    }
+}
+
+// the pixels the triangle covers when drawn with the 16.8 setup, whose guard band takes range.
+static void coverage(const Vertex vertices[3], float range, std::vector<unsigned int> &fb) {
+    std::vector<unsigned short> db(WIDTH * HEIGHT);
+    unsigned int indices[3] = {0, 1, 2};
+    TileRenderer renderer(WIDTH, HEIGHT, 1);
+    renderer.set_setup(triangle_setup<16, 8>, range);
+    RasterState state{};
+    state.cull = CULL_NONE;
+    renderer.set_state(state);
+    renderer.clear(0, 0);
+    renderer.draw_indexed(vertices, 3, indices, 3, TransformShader{glm::mat4(1.f)});
+    renderer.flush(nullptr, db.data(), fb.data());
+    renderer.resolve(db.data(), fb.data());
+}
+
+// the distance from the center of pixel i to the nearest edge of the triangle, in pixels.
+static double edge_distance(const Vertex vertices[3], int i) {
+    double px = (double) (i % WIDTH) + 0.5, py = (double) (i / WIDTH) + 0.5;
+    double x[3], y[3];
+    for (int k = 0; k < 3; k++) {
+        x[k] = ((double) vertices[k].position.x / vertices[k].position.w + 1.0) * WIDTH / 2;
+        y[k] = ((double) vertices[k].position.y / vertices[k].position.w + 1.0) * HEIGHT / 2;
+    }
+    double nearest = HUGE_VAL;
+    for (int k = 0; k < 3; k++) {
+        double dx = x[(k + 1) % 3] - x[k], dy = y[(k + 1) % 3] - y[k];
+        double d = std::fabs((px - x[k]) * dy - (py - y[k]) * dx) / std::sqrt(dx * dx + dy * dy);
+        if (d < nearest) nearest = d;
+    }
+    return nearest;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    std::vector<unsigned int> guarded(WIDTH * HEIGHT), clipped(WIDTH * HEIGHT);
+    int differing = 0;
+    for (int t = 0; t < 2000; t++) {
+        Vertex vertices[3];
+        for (auto &vertex: vertices) {
+            // depth well inside the near and far planes, only the sides are ever clipped.
+            float w = std::uniform_real_distribution<float>(1.f, 4.f)(rng);
+            float z = std::uniform_real_distribution<float>(-0.9f, 0.9f)(rng) * w;
+            vertex = Vertex(glm::vec4(coordinate(rng, w), coordinate(rng, w), z, w),
+                            glm::vec2(std::uniform_real_distribution<float>(0.f, 1.f)(rng), 0.5f));
+        }
+        coverage(vertices, setup_range<16, 8>(), guarded);
+        coverage(vertices, 0.f, clipped);
+        for (int i = 0; i < WIDTH * HEIGHT; i++) {
+            if ((guarded[i] != 0) != (clipped[i] != 0) && edge_distance(vertices, i) > 1.0 / 256) differing++;
+        }
+    }
+    if (differing) printf("%d pixels covered by only one of the guard band and clipped triangles\n", differing);
+    return differing ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// the shortcuts the setup takes for many triangles at once must give the same setups as every
+// triangle set up on its own, whatever the triangles: off the screen, out of range, zero area,
+// back facing or scissored away.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "rasterizer.h"
+
+static const int WIDTH = 320, HEIGHT = 240;
+
+static const struct {
+    const char *name;
+    TriangleSetupFunc setup;
+    float range;
+} cases[] = {
+        {"12.0", triangle_setup, 2047.f},
+        {"12.4", triangle_setup<12, 4>, setup_range<12, 4>()},
+        {"16.8", triangle_setup<16, 8>, setup_range<16, 8>()},
+};
+
+static bool same_setup(const TriangleSetup &a, const TriangleSetup &b) {
+    return a.min_x == b.min_x && a.min_y == b.min_y && a.max_x == b.max_x && a.max_y == b.max_y &&
+           a.x0 == b.x0 && a.y0 == b.y0 && a.d0 == b.d0 && a.u0 == b.u0 && a.v0 == b.v0 &&
+           a.F01_0 == b.F01_0 && a.F12_0 == b.F12_0 && a.F20_0 == b.F20_0 &&
+           a.DF01DX == b.DF01DX && a.DF12DX == b.DF12DX && a.DF20DX == b.DF20DX &&
+           a.DF01DY == b.DF01DY && a.DF12DY == b.DF12DY && a.DF20DY == b.DF20DY && a.edge_bits == b.edge_bits &&
+           a.DZDX == b.DZDX && a.DZDY == b.DZDY && a.DUDX == b.DUDX && a.DUDY == b.DUDY &&
+           a.DVDX == b.DVDX && a.DVDY == b.DVDY && a.depth_clip == b.depth_clip && a.depth_clamp == b.depth_clamp;
+}
+
+static float uniform(std::mt19937 &rng, float a, float b) {
+    return std::uniform_real_distribution<float>(a, b)(rng);
+}
+
+// a coordinate around the screen, now and then far off it or past range, and now and then on a
+// whole or half pixel, so vertices and edges land right on pixel centers.
+static float coordinate(std::mt19937 &rng, float size, float range) {
+    float c;
+    switch (rng() % 8) {
+        case 0:
+            c = uniform(rng, -range, range);
+            break;
+        case 1:
+            c = uniform(rng, -1.1f * range, 1.1f * range);
+            break;
+        default:
+            c = uniform(rng, -40.f, size + 40.f);
+            break;
+    }
+    switch (rng() % 4) {
+        case 0:
+            return roundf(c);
+        case 1:
+            return roundf(c * 2.f) * 0.5f;
+        default:
+            return c;
+    }
+}
+
+static Vertex random_vertex(std::mt19937 &rng, float range) {
+    return Vertex(glm::vec4(coordinate(rng, WIDTH, range), coordinate(rng, HEIGHT, range), uniform(rng, 0.f, 1.f), 1.f),
+                  glm::vec2(uniform(rng, 0.f, 1.f), uniform(rng, 0.f, 1.f)));
+}
+
+// the whole screen, or a random part of it.
+static Rect random_scissor(std::mt19937 &rng) {
+    if (rng() % 2) return Rect{0, 0, WIDTH, HEIGHT};
+    int min_x = (int) (rng() % WIDTH), min_y = (int) (rng() % HEIGHT);
+    return Rect{min_x, min_y, min_x + 1 + (int) (rng() % (WIDTH - min_x)), min_y + 1 + (int) (rng() % (HEIGHT - min_y))};
+}
+
+// a polygon of n vertices around a random center, going either way round. some are squashed to
+// a line or a point, so parts of their fans have no area.
+static void random_polygon(std::mt19937 &rng, float range, Vertex polygon[], int n) {
+    Vertex center = random_vertex(rng, range);
+    float rx = uniform(rng, 0.f, 200.f), ry = uniform(rng, 0.f, 200.f);
+    if (rng() % 8 == 0) ry = 0.f;
+    if (rng() % 16 == 0) rx = ry = 0.f;
+    float turn = rng() % 2 ? 6.2831853f : -6.2831853f;
+    float start = uniform(rng, 0.f, 6.2831853f);
+    for (int i = 0; i < n; i++) {
+        float angle = start + turn * ((float) i + uniform(rng, 0.f, 0.9f)) / (float) n;
+        polygon[i] = Vertex(glm::vec4(center.position.x + rx * cosf(angle), center.position.y + ry * sinf(angle),
+                                      uniform(rng, 0.f, 1.f), 1.f),
+                            glm::vec2(uniform(rng, 0.f, 1.f), uniform(rng, 0.f, 1.f)));
+        // an odd vertex on top of its neighbour.
+        if (i && rng() % 16 == 0) polygon[i].position = polygon[i - 1].position;
+    }
+}
+
+// setups[0, count) against the triangles of reference[0, n) func does not reject, in order.
+static bool same_setups(TriangleSetupFunc func, const Vertex reference[][3], int n, const Rect &scissor,
+                        const TriangleSetup setups[], int count) {
+    int expected = 0;
+    for (int i = 0; i < n; i++) {
+        TriangleSetup setup{};
+        if (!func(reference[i], scissor, setup)) continue;
+        if (expected == count || !same_setup(setup, setups[expected])) return false;
+        expected++;
+    }
+    return expected == count;
+}
+
+// triangle_fan_setup() of random polygons, both ways round for the structure of arrays one.
+static int fan_mismatches(TriangleSetupFunc func, float range, std::mt19937 &rng) {
+    int mismatches = 0;
+    for (int t = 0; t < 4000; t++) {
+        int n = 3 + (int) (rng() % (FAN_MAX_VERTICES - 2));
+        Vertex polygon[FAN_MAX_VERTICES];
+        random_polygon(rng, range, polygon, n);
+        Rect scissor = random_scissor(rng);
+        ClipPolygon lanes;
+        for (int i = 0; i < n; i++) {
+            lanes.x[i] = polygon[i].position.x;
+            lanes.y[i] = polygon[i].position.y;
+            lanes.z[i] = polygon[i].position.z;
+            lanes.w[i] = polygon[i].position.w;
+            lanes.u[i] = polygon[i].texcoord.x;
+            lanes.v[i] = polygon[i].texcoord.y;
+        }
+        for (int way = 0; way < 3; way++) {
+            // vertex i of the fan, the other way round the last time.
+            auto vertex = [&](int i) { return polygon[way == 2 && i ? n - i : i]; };
+            Vertex reference[FAN_MAX_VERTICES - 2][3];
+            for (int i = 2; i < n; i++) {
+                reference[i - 2][0] = vertex(0);
+                reference[i - 2][1] = vertex(i - 1);
+                reference[i - 2][2] = vertex(i);
+            }
+            TriangleSetup setups[FAN_MAX_VERTICES - 2];
+            int count = way == 0 ? triangle_fan_setup(func, polygon, n, scissor, setups)
+                                 : triangle_fan_setup(func, lanes, n, way == 2, scissor, setups);
+            if (!same_setups(func, reference, n - 2, scissor, setups, count)) mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+// up to SETUP_BATCH triangles over a pool of vertices, some of them around one point so their
+// triangles are small, the indices picked at random so some repeat.
+static int random_batch(std::mt19937 &rng, float range, Vertex pool[16], unsigned int indices[SETUP_BATCH * 3]) {
+    random_polygon(rng, range, pool, FAN_MAX_VERTICES);
+    for (int i = FAN_MAX_VERTICES; i < 16; i++) pool[i] = random_vertex(rng, range);
+    int n = 1 + (int) (rng() % SETUP_BATCH);
+    for (int i = 0; i < 3 * n; i++) indices[i] = rng() % 16;
+    return n;
+}
+
+// triangle i of indices, its positions gathered into lane i of x / y.
+static void gather_batch(const Vertex pool[16], const unsigned int indices[], int n, Vertex triangles[][3],
+                         float x[3][SETUP_BATCH], float y[3][SETUP_BATCH]) {
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            triangles[i][k] = pool[indices[3 * i + k]];
+            x[k][i] = triangles[i][k].position.x;
+            y[k][i] = triangles[i][k].position.y;
+        }
+    }
+}
+
+// triangle_setup_batch() of random batches.
+static int batch_mismatches(TriangleSetupFunc func, float range, std::mt19937 &rng) {
+    int mismatches = 0;
+    VertexStream stream;
+    for (int t = 0; t < 4000; t++) {
+        Vertex pool[16];
+        unsigned int indices[SETUP_BATCH * 3];
+        int n = random_batch(rng, range, pool, indices);
+        Rect scissor = random_scissor(rng);
+        stream_load(stream, pool, 16);
+        Vertex triangles[SETUP_BATCH][3];
+        alignas(32) float x[3][SETUP_BATCH] = {}, y[3][SETUP_BATCH] = {};
+        gather_batch(pool, indices, n, triangles, x, y);
+        TriangleSetup setups[SETUP_BATCH];
+        int count = triangle_setup_batch(func, stream, indices, x, y, n, scissor, setups);
+        if (!same_setups(func, triangles, n, scissor, setups, count)) mismatches++;
+    }
+    return mismatches;
+}
+
+// triangle_cull() of random batches against which way round each triangle sets up.
+static int cull_mismatches(TriangleSetupFunc func, float range, std::mt19937 &rng) {
+    const unsigned int choices[] = {WINDING_CCW, WINDING_CW, WINDING_CCW | WINDING_CW};
+    int mismatches = 0;
+    for (int t = 0; t < 4000; t++) {
+        Vertex pool[16];
+        unsigned int indices[SETUP_BATCH * 3];
+        int n = random_batch(rng, range, pool, indices);
+        Rect scissor = random_scissor(rng);
+        unsigned int windings = choices[rng() % 3];
+        Vertex triangles[SETUP_BATCH][3];
+        alignas(32) float x[3][SETUP_BATCH] = {}, y[3][SETUP_BATCH] = {};
+        gather_batch(pool, indices, n, triangles, x, y);
+        unsigned int out[SETUP_BATCH];
+        triangle_cull(func, x, y, n, scissor, windings, out);
+        for (int i = 0; i < n; i++) {
+            Vertex reversed[3] = {triangles[i][0], triangles[i][2], triangles[i][1]};
+            TriangleSetup setup{};
+            unsigned int expected = 0;
+            if (func(triangles[i], scissor, setup)) expected |= WINDING_CCW;
+            if (func(reversed, scissor, setup)) expected |= WINDING_CW;
+            if (out[i] != (expected & windings)) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    int failed = 0;
+    for (auto &c: cases) {
+        int fans = fan_mismatches(c.setup, c.range, rng);
+        if (fans) {
+            printf("%s: %d fans set up differently\n", c.name, fans);
+            failed++;
+        }
+        int batches = batch_mismatches(c.setup, c.range, rng);
+        if (batches) {
+            printf("%s: %d batches set up differently\n", c.name, batches);
+            failed++;
+        }
+        int culls = cull_mismatches(c.setup, c.range, rng);
+        if (culls) {
+            printf("%s: %d batches culled differently\n", c.name, culls);
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "texture.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static inline int log2_exact(unsigned int size) {
+    if (size == 0 || (size & (size - 1))) return -1;
+    int shift = 0;
+    while ((1u << shift) < size) shift++;
+    return shift;
+}
+
+static inline unsigned int texel_size(TextureFormat format) {
+    return format == TEX_L8 ? 1 : 4;
+}
+
+static TextureLevel make_level(unsigned int width, unsigned int height, TextureFormat format, TextureLayout layout,
+                               unsigned int offset) {
+    TextureLevel level{};
+    level.width = width;
+    level.height = height;
+    // a row of tiles is 4 rows of texels.
+    level.stride = layout == LAYOUT_TILED ? (width + 3) / 4 * 16 * texel_size(format) : width * texel_size(format);
+    level.width_shift = log2_exact(width);
+    level.height_shift = log2_exact(height);
+    if (level.width_shift < 0 || level.height_shift < 0) level.width_shift = level.height_shift = -1;
+    level.offset = offset;
+    return level;
+}
+
+static unsigned int level_bytes(const TextureLevel &level, TextureLayout layout) {
+    return level.stride * (layout == LAYOUT_TILED ? (level.height + 3) / 4 : level.height);
+}
+
+// byte offset of texel (x, y) inside level.
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static inline int texel_offset(const TextureLevel &level, int x, int y) {
+    const int size = FORMAT == TEX_L8 ? 1 : 4;
+    if (LAYOUT == LAYOUT_LINEAR) return y * (int) level.stride + x * size;
+    int z = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2;
+    return (y >> 2) * (int) level.stride + ((x >> 2) * 16 + z) * size;
+}
+
+// copy level between the texture and a linear image whose rows are pitch bytes apart.
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static void copy_level(Texture &tex, const TextureLevel &level, unsigned char *image, unsigned int pitch,
+                       bool to_image) {
+    const unsigned int size = FORMAT == TEX_L8 ? 1 : 4;
+    unsigned char *texels = tex.texels.data() + level.offset;
+    for (unsigned int y = 0; y < level.height; y++) {
+        unsigned char *row = image + y * pitch;
+        if (LAYOUT == LAYOUT_LINEAR) {
+            if (to_image) memcpy(row, texels + y * level.stride, level.width * size);
+            else memcpy(texels + y * level.stride, row, level.width * size);
+            continue;
+        }
+        for (unsigned int x = 0; x < level.width; x++) {
+            unsigned char *texel = texels + texel_offset<FORMAT, LAYOUT>(level, (int) x, (int) y);
+            if (to_image) memcpy(row + x * size, texel, size);
+            else memcpy(texel, row + x * size, size);
+        }
+    }
+}
+
+template<TextureFormat FORMAT>
+static void copy_level(Texture &tex, const TextureLevel &level, unsigned char *image, unsigned int pitch,
+                       bool to_image) {
+    if (tex.layout == LAYOUT_TILED) copy_level<FORMAT, LAYOUT_TILED>(tex, level, image, pitch, to_image);
+    else copy_level<FORMAT, LAYOUT_LINEAR>(tex, level, image, pitch, to_image);
+}
+
+static void copy_level(Texture &tex, const TextureLevel &level, unsigned char *image, unsigned int pitch,
+                       bool to_image) {
+    if (tex.format == TEX_L8) copy_level<TEX_L8>(tex, level, image, pitch, to_image);
+    else copy_level<TEX_ARGB8888>(tex, level, image, pitch, to_image);
+}
+
+Texture::Texture(unsigned int width, unsigned int height, TextureFormat format, const void *pixels,
+                 unsigned int stride, TextureLayout layout) :
+        width(width), height(height), format(format), layout(layout) {
+    if (stride == 0) stride = width * texel_size(format);
+    levels.push_back(make_level(width, height, format, layout, 0));
+    // the vector paths read whole words, even for 1 byte texels.
+    texels.assign(level_bytes(levels[0], layout) + 4, 0);
+    copy_level(*this, levels[0], static_cast<unsigned char *>(const_cast<void *>(pixels)), stride, false);
+    set_sampler(filter, address, mip);
+}
+
+// dst[x] = (a[2x] + a[2x + 1] + b[2x] + b[2x + 1] + 2) / 4 for each channel of a row of
+// texels of size bytes, src_width texels wide.
+static void box_filter_row(const unsigned char *a, const unsigned char *b, unsigned int src_width,
+                           unsigned char *dst, unsigned int width, unsigned int size) {
+    unsigned int i = 0, n = width * size;
+#if defined(__SSE2__)
+    // 32 source bytes of each row make 16 bytes of output.
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2), low = _mm_set1_epi16(0xff);
+    for (; src_width >= 2 && i + 16 <= n; i += 16) {
+        __m128i half[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i * 2 + k * 16));
+            __m128i rb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i * 2 + k * 16));
+            __m128i sum;
+            if (size == 1) {
+                // neighbours are the even and odd bytes.
+                sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(ra, low), _mm_srli_epi16(ra, 8)),
+                                    _mm_add_epi16(_mm_and_si128(rb, low), _mm_srli_epi16(rb, 8)));
+            } else {
+                // channels of texels 0, 1 and 2, 3 as words, then add the neighbouring texels.
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+                sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            }
+            half[k] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(half[0], half[1]));
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned int x0 = i / size * 2, x1 = std::min(x0 + 1, src_width - 1), c = i % size;
+        dst[i] = (unsigned char) ((a[x0 * size + c] + a[x1 * size + c] + b[x0 * size + c] + b[x1 * size + c] + 2) >> 2);
+    }
+}
+
+static void box_filter(const unsigned char *src, unsigned int src_width, unsigned int src_height,
+                       unsigned char *dst, unsigned int width, unsigned int height, unsigned int size,
+                       unsigned int threads) {
+    auto rows = [=](unsigned int y0, unsigned int y1) {
+        for (unsigned int y = y0; y < y1; y++) {
+            const unsigned char *a = src + y * 2 * src_width * size;
+            const unsigned char *b = src + std::min(y * 2 + 1, src_height - 1) * src_width * size;
+            box_filter_row(a, b, src_width, dst + y * width * size, width, size);
+        }
+    };
+    // small levels are done before a thread would have started.
+    if (threads <= 1 || width * height < 256 * 256) {
+        rows(0, height);
+        return;
+    }
+    std::vector<std::thread> pool;
+    unsigned int chunk = (height + threads - 1) / threads;
+    for (unsigned int y = 0; y < height; y += chunk) {
+        pool.emplace_back(rows, y, std::min(y + chunk, height));
+    }
+    for (auto &t: pool) t.join();
+}
+
+void Texture::generate_mipmaps(unsigned int threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int size = texel_size(format);
+    // filter linear images of the levels, then store them all in the layout.
+    std::vector<std::vector<unsigned char>> images(1);
+    images[0].resize(width * height * size);
+    copy_level(*this, levels[0], images[0].data(), width * size, true);
+    levels.resize(1);
+    unsigned int offset = level_bytes(levels[0], layout);
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const TextureLevel &src = levels.back();
+        TextureLevel level = make_level(std::max(1u, src.width / 2), std::max(1u, src.height / 2), format, layout,
+                                        offset);
+        images.emplace_back(level.width * level.height * size);
+        box_filter(images[images.size() - 2].data(), src.width, src.height, images.back().data(), level.width,
+                   level.height, size, threads);
+        offset += level_bytes(level, layout);
+        levels.push_back(level);
+    }
+    texels.assign(offset + 4, 0);
+    for (size_t i = 0; i < levels.size(); i++) {
+        copy_level(*this, levels[i], images[i].data(), levels[i].width * size, false);
+    }
+}
+
+int Texture::lod(int dudx, int dudy, int dvdx, int dvdy) const {
+    if (mip == MIP_NONE || levels.size() == 1) return 0;
+    // squared texels per pixel along the screen axes, the steps are in 1/4096 of the texture.
+    float ux = (float) dudx * (float) width, vx = (float) dvdx * (float) height;
+    float uy = (float) dudy * (float) width, vy = (float) dvdy * (float) height;
+    float rho = std::max(ux * ux + vx * vx, uy * uy + vy * vy) / (4096.f * 4096.f);
+    if (rho <= 1.f) return 0;
+    // log2 of the length, in 1/256 levels.
+    int lod = (int) (128.f * std::log2(rho));
+    return std::min(lod, (int) (levels.size() - 1) * 256);
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static inline unsigned int fetch(const Texture &tex, const TextureLevel &level, int x, int y) {
+    const unsigned char *texel = tex.texels.data() + level.offset + texel_offset<FORMAT, LAYOUT>(level, x, y);
+    if (FORMAT == TEX_L8) return 0xff000000 | texel[0] * 0x010101u;
+    return *reinterpret_cast<const unsigned int *>(texel);
+}
+
+// (c0 * (256 - f) + c1 * f) / 256 per channel, two channels per multiply.
+static inline unsigned int lerp_argb(unsigned int c0, unsigned int c1, unsigned int f) {
+    unsigned int rb = (((c0 & 0x00ff00ff) * (256 - f) + (c1 & 0x00ff00ff) * f) >> 8) & 0x00ff00ff;
+    unsigned int ag = (((c0 >> 8) & 0x00ff00ff) * (256 - f) + ((c1 >> 8) & 0x00ff00ff) * f) & 0xff00ff00;
+    return rb | ag;
+}
+
+// texture space coordinate in 1/4096 texels.
+template<bool POT>
+static inline int texel_space(int u, unsigned int size, int shift) {
+    return POT ? u << shift : u * (int) size;
+}
+
+// the two texels of a bilinear footprint along one axis, s being the sample position minus
+// half a texel, in [-1/2, size - 1/2) texels.
+template<TextureAddress ADDRESS, bool POT>
+static inline void footprint(int s, int size, int &i0, int &i1) {
+    i0 = s >> 12;
+    i1 = i0 + 1;
+    if (ADDRESS == ADDRESS_CLAMP) {
+        if (i0 < 0) i0 = 0;
+        if (i1 > size - 1) i1 = size - 1;
+    } else if (POT) {
+        i0 &= size - 1;
+        i1 &= size - 1;
+    } else {
+        if (i0 < 0) i0 += size;
+        if (i1 == size) i1 = 0;
+    }
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER, TextureAddress ADDRESS, bool POT>
+static inline unsigned int sample_texel(const Texture &tex, const TextureLevel &level, int u, int v) {
+    int s = texel_space<POT>(u, level.width, level.width_shift);
+    int t = texel_space<POT>(v, level.height, level.height_shift);
+    if (FILTER == FILTER_NEAREST) return fetch<FORMAT, LAYOUT>(tex, level, s >> 12, t >> 12);
+    s -= 2048;
+    t -= 2048;
+    int x0, x1, y0, y1;
+    footprint<ADDRESS, POT>(s, (int) level.width, x0, x1);
+    footprint<ADDRESS, POT>(t, (int) level.height, y0, y1);
+    unsigned int fx = (s >> 4) & 0xff, fy = (t >> 4) & 0xff;
+    unsigned int top = lerp_argb(fetch<FORMAT, LAYOUT>(tex, level, x0, y0), fetch<FORMAT, LAYOUT>(tex, level, x1, y0), fx);
+    unsigned int bottom = lerp_argb(fetch<FORMAT, LAYOUT>(tex, level, x0, y1), fetch<FORMAT, LAYOUT>(tex, level, x1, y1), fx);
+    return lerp_argb(top, bottom, fy);
+}
+
+#if defined(__AVX2__)
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static inline __m256i texel_offset(const TextureLevel &level, __m256i x, __m256i y) {
+    const int shift = FORMAT == TEX_L8 ? 0 : 2;
+    const __m256i stride = _mm256_set1_epi32((int) level.stride);
+    if (LAYOUT == LAYOUT_LINEAR) return _mm256_add_epi32(_mm256_mullo_epi32(y, stride), _mm256_slli_epi32(x, shift));
+    const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+    __m256i z = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(x, one), _mm256_slli_epi32(_mm256_and_si256(y, one), 1)),
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, two), 1), _mm256_slli_epi32(_mm256_and_si256(y, two), 2)));
+    __m256i texel = _mm256_add_epi32(_mm256_slli_epi32(_mm256_srai_epi32(x, 2), 4), z);
+    return _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(y, 2), stride), _mm256_slli_epi32(texel, shift));
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static inline __m256i fetch(const Texture &tex, const TextureLevel &level, __m256i x, __m256i y) {
+    const auto *base = reinterpret_cast<const int *>(tex.texels.data() + level.offset);
+    __m256i offset = texel_offset<FORMAT, LAYOUT>(level, x, y);
+    __m256i texel = _mm256_i32gather_epi32(base, offset, 1);
+    if (FORMAT == TEX_L8) {
+        __m256i l = _mm256_and_si256(texel, _mm256_set1_epi32(0xff));
+        return _mm256_or_si256(_mm256_set1_epi32((int) 0xff000000), _mm256_mullo_epi32(l, _mm256_set1_epi32(0x010101)));
+    }
+    return texel;
+}
+
+static inline __m256i lerp_argb(__m256i c0, __m256i c1, __m256i f) {
+    const __m256i mask = _mm256_set1_epi32(0x00ff00ff);
+    __m256i g = _mm256_sub_epi32(_mm256_set1_epi32(256), f);
+    __m256i rb = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(c0, mask), g),
+                                  _mm256_mullo_epi32(_mm256_and_si256(c1, mask), f));
+    __m256i ag = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 8), mask), g),
+                                  _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(c1, 8), mask), f));
+    return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(rb, 8), mask),
+                           _mm256_andnot_si256(mask, ag));
+}
+
+template<bool POT>
+static inline __m256i texel_space(__m256i u, unsigned int size, int shift) {
+    if (POT) return _mm256_sll_epi32(u, _mm_cvtsi32_si128(shift));
+    return _mm256_mullo_epi32(u, _mm256_set1_epi32((int) size));
+}
+
+template<TextureAddress ADDRESS, bool POT>
+static inline void footprint(__m256i s, int size, __m256i &i0, __m256i &i1) {
+    const __m256i one = _mm256_set1_epi32(1);
+    i0 = _mm256_srai_epi32(s, 12);
+    i1 = _mm256_add_epi32(i0, one);
+    if (ADDRESS == ADDRESS_CLAMP) {
+        i0 = _mm256_max_epi32(i0, _mm256_setzero_si256());
+        i1 = _mm256_min_epi32(i1, _mm256_set1_epi32(size - 1));
+    } else if (POT) {
+        i0 = _mm256_and_si256(i0, _mm256_set1_epi32(size - 1));
+        i1 = _mm256_and_si256(i1, _mm256_set1_epi32(size - 1));
+    } else {
+        i0 = _mm256_add_epi32(i0, _mm256_and_si256(_mm256_srai_epi32(i0, 31), _mm256_set1_epi32(size)));
+        i1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(i1, _mm256_set1_epi32(size)), i1);
+    }
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER, TextureAddress ADDRESS, bool POT>
+static inline __m256i sample_avx2(const Texture &tex, const TextureLevel &level, __m256i u, __m256i v) {
+    __m256i s = texel_space<POT>(u, level.width, level.width_shift);
+    __m256i t = texel_space<POT>(v, level.height, level.height_shift);
+    if (FILTER == FILTER_NEAREST) {
+        return fetch<FORMAT, LAYOUT>(tex, level, _mm256_srai_epi32(s, 12), _mm256_srai_epi32(t, 12));
+    }
+    s = _mm256_sub_epi32(s, _mm256_set1_epi32(2048));
+    t = _mm256_sub_epi32(t, _mm256_set1_epi32(2048));
+    __m256i x0, x1, y0, y1;
+    footprint<ADDRESS, POT>(s, (int) level.width, x0, x1);
+    footprint<ADDRESS, POT>(t, (int) level.height, y0, y1);
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    __m256i fx = _mm256_and_si256(_mm256_srai_epi32(s, 4), byte);
+    __m256i fy = _mm256_and_si256(_mm256_srai_epi32(t, 4), byte);
+    __m256i top = lerp_argb(fetch<FORMAT, LAYOUT>(tex, level, x0, y0), fetch<FORMAT, LAYOUT>(tex, level, x1, y0), fx);
+    __m256i bottom = lerp_argb(fetch<FORMAT, LAYOUT>(tex, level, x0, y1), fetch<FORMAT, LAYOUT>(tex, level, x1, y1), fx);
+    return lerp_argb(top, bottom, fy);
+}
+
+#endif
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER, TextureAddress ADDRESS, bool POT>
+static void sample_level(const Texture &tex, const TextureLevel &level, const int *u, const int *v,
+                         unsigned int *out, int n) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i c = sample_avx2<FORMAT, LAYOUT, FILTER, ADDRESS, POT>(
+                tex, level, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), c);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = sample_texel<FORMAT, LAYOUT, FILTER, ADDRESS, POT>(tex, level, u[i], v[i]);
+    }
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER, TextureAddress ADDRESS, bool POT>
+static void sample(const Texture &tex, int lod, const int *u, const int *v, unsigned int *out, int n) {
+    unsigned int f = lod & 0xff;
+    if (tex.mip != MIP_LINEAR || f == 0) {
+        const TextureLevel &level = tex.levels[tex.mip == MIP_NEAREST ? (lod + 128) >> 8 : lod >> 8];
+        sample_level<FORMAT, LAYOUT, FILTER, ADDRESS, POT>(tex, level, u, v, out, n);
+        return;
+    }
+    // trilinear, blend in the next level 8 texels at a time.
+    const TextureLevel &fine = tex.levels[lod >> 8], &coarse = tex.levels[(lod >> 8) + 1];
+    for (int i = 0; i < n; i += 8) {
+        int m = std::min(8, n - i);
+        unsigned int c[8];
+        sample_level<FORMAT, LAYOUT, FILTER, ADDRESS, POT>(tex, fine, u + i, v + i, out + i, m);
+        sample_level<FORMAT, LAYOUT, FILTER, ADDRESS, POT>(tex, coarse, u + i, v + i, c, m);
+        for (int j = 0; j < m; j++) out[i + j] = lerp_argb(out[i + j], c[j], f);
+    }
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER, TextureAddress ADDRESS>
+static SampleFunc select_sample(bool pot) {
+    return pot ? sample<FORMAT, LAYOUT, FILTER, ADDRESS, true> : sample<FORMAT, LAYOUT, FILTER, ADDRESS, false>;
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT, TextureFilter FILTER>
+static SampleFunc select_sample(TextureAddress address, bool pot) {
+    if (address == ADDRESS_CLAMP) return select_sample<FORMAT, LAYOUT, FILTER, ADDRESS_CLAMP>(pot);
+    return select_sample<FORMAT, LAYOUT, FILTER, ADDRESS_WRAP>(pot);
+}
+
+template<TextureFormat FORMAT, TextureLayout LAYOUT>
+static SampleFunc select_sample(TextureFilter filter, TextureAddress address, bool pot) {
+    if (filter == FILTER_BILINEAR) return select_sample<FORMAT, LAYOUT, FILTER_BILINEAR>(address, pot);
+    return select_sample<FORMAT, LAYOUT, FILTER_NEAREST>(address, pot);
+}
+
+template<TextureFormat FORMAT>
+static SampleFunc select_sample(TextureLayout layout, TextureFilter filter, TextureAddress address, bool pot) {
+    if (layout == LAYOUT_TILED) return select_sample<FORMAT, LAYOUT_TILED>(filter, address, pot);
+    return select_sample<FORMAT, LAYOUT_LINEAR>(filter, address, pot);
+}
+
+void Texture::set_sampler(TextureFilter _filter, TextureAddress _address, TextureMip _mip) {
+    filter = _filter;
+    address = _address;
+    mip = _mip;
+    // every level of a power of two texture is a power of two.
+    bool pot = levels[0].width_shift >= 0;
+    if (format == TEX_L8) {
+        sample = select_sample<TEX_L8>(layout, filter, address, pot);
+    } else {
+        sample = select_sample<TEX_ARGB8888>(layout, filter, address, pot);
+    }
+}
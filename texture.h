@@ -0,0 +1,82 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_TEXTURE_H
+#define SIMPLE_SOFT_RASTERIZER_TEXTURE_H
+
+#include <vector>
+
+enum TextureFormat {
+    // 0xAARRGGBB, the framebuffer format.
+    TEX_ARGB8888,
+    // one byte of luminance, read as 0xffLLLLLL.
+    TEX_L8
+};
+
+enum TextureFilter {
+    FILTER_NEAREST, FILTER_BILINEAR
+};
+
+// what the bilinear footprint does at the border. texture coordinates themselves always
+// repeat, they are interpolated modulo 1.0.
+enum TextureAddress {
+    ADDRESS_WRAP, ADDRESS_CLAMP
+};
+
+// how texels are stored. tiled keeps each 4x4 block in 16 consecutive texels (Z order
+// inside the block, one 64 byte line for ARGB8888), so a footprint that walks across rows
+// does not touch a new line per row.
+enum TextureLayout {
+    LAYOUT_LINEAR, LAYOUT_TILED
+};
+
+// how the level of detail picks mip levels. MIP_LINEAR blends the two nearest (trilinear).
+enum TextureMip {
+    MIP_NONE, MIP_NEAREST, MIP_LINEAR
+};
+
+struct TextureLevel {
+    unsigned int width, height;
+    // bytes between rows of texels (linear) or of tiles (tiled).
+    unsigned int stride;
+    // log2 of width / height when both are powers of two, -1 otherwise.
+    int width_shift, height_shift;
+    // where the level starts in texels.
+    unsigned int offset;
+};
+
+class Texture;
+
+// sample n texels at unsigned 0.12 coordinates (u[i], v[i]) into ARGB8888 out[i], lod being
+// the level of detail in 1/256 levels as returned by Texture::lod().
+using SampleFunc = void (*)(const Texture &tex, int lod, const int *u, const int *v, unsigned int *out, int n);
+
+class Texture {
+public:
+    // copy a width x height linear image whose rows are stride bytes apart (0: tightly packed),
+    // converting it to layout.
+    Texture(unsigned int width, unsigned int height, TextureFormat format, const void *pixels,
+            unsigned int stride = 0, TextureLayout layout = LAYOUT_LINEAR);
+
+    // build the chain of 2x2 box filtered levels down to 1x1 from level 0. big levels are
+    // filtered by several threads, threads == 0 picks std::thread::hardware_concurrency().
+    void generate_mipmaps(unsigned int threads = 0);
+
+    void set_sampler(TextureFilter filter, TextureAddress address, TextureMip mip = MIP_NONE);
+
+    // level of detail in 1/256 levels for per pixel coordinate steps in 1/4096 (the DUDX ...
+    // of a triangle setup), clamped to the levels present. always 0 with MIP_NONE.
+    int lod(int dudx, int dudy, int dvdx, int dvdy) const;
+
+    // size of level 0.
+    unsigned int width, height;
+    TextureFormat format;
+    TextureLayout layout;
+    TextureFilter filter = FILTER_NEAREST;
+    TextureAddress address = ADDRESS_WRAP;
+    TextureMip mip = MIP_NONE;
+
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> texels;
+    // specialized for the format, sampler state and size above.
+    SampleFunc sample;
+};
+
+#endif //SIMPLE_SOFT_RASTERIZER_TEXTURE_H
@@ -0,0 +1,364 @@
+#include <algorithm>
+
+#include "tile_renderer.h"
+#include "depth_planes.h"
+#include "hiz.h"
+#include "surface.h"
+
+TileRenderer::TileRenderer(unsigned int width, unsigned int height, unsigned int threads) :
+        width(width), height(height),
+        tiles_x((width + TILE_SIZE - 1) / TILE_SIZE), tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+        scissor{0, 0, (int) width, (int) height}, bins(tiles_x * tiles_y), tile_state(tiles_x * tiles_y, TILE_DRAWN) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    // the flushing thread works too.
+    for (unsigned int i = 1; i < threads; i++) {
+        workers.emplace_back(&TileRenderer::worker_main, this);
+    }
+}
+
+TileRenderer::~TileRenderer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto &worker: workers) worker.join();
+}
+
+void TileRenderer::set_scissor(const Rect &_scissor) {
+    scissor = rect_intersect(_scissor, Rect{0, 0, (int) width, (int) height});
+}
+
+void TileRenderer::set_setup(TriangleSetupFunc setup, float range) {
+    setup_func = setup;
+    // screen x = (x / w + 1) * width / 2 stays within +-range up to x / w = 2 * range / width - 1.
+    guard_x = std::max(1.f, 2.f * range / (float) width - 1.f);
+    guard_y = std::max(1.f, 2.f * range / (float) height - 1.f);
+}
+
+void TileRenderer::set_state(const RasterState &_state) {
+    state = _state;
+    unsigned int front = state.front_face == FRONT_CCW ? WINDING_CCW : WINDING_CW;
+    unsigned int back = front ^ (WINDING_CCW | WINDING_CW);
+    windings = state.cull == CULL_NONE ? front | back : state.cull == CULL_FRONT ? back : front;
+    raster_func = program.select(state);
+    visibility_func = select_visibility(state);
+}
+
+void TileRenderer::set_program(const FragmentProgram &_program) {
+    program = _program;
+    raster_func = program.select(state);
+}
+
+void TileRenderer::set_homogeneous(bool _homogeneous) {
+    homogeneous = _homogeneous;
+}
+
+// set up input with func as any of windings: every setup takes counterclockwise triangles
+// only, clockwise ones are set up the other way around.
+static bool setup_wound(TriangleSetupFunc func, const Vertex input[3], unsigned int windings, const Rect &scissor,
+                        TriangleSetup &setup) {
+    if ((windings & WINDING_CCW) && func(input, scissor, setup)) return true;
+    if (!(windings & WINDING_CW)) return false;
+    Vertex reversed[3] = {input[0], input[2], input[1]};
+    return func(reversed, scissor, setup);
+}
+
+void TileRenderer::draw(const Vertex input[3]) {
+    TriangleSetup setup{};
+    // the bounding box comes back clipped to the scissor, and is exclusive.
+    if (!setup_wound(setup_func, input, windings, scissor, setup)) return;
+    bin(setup);
+}
+
+void TileRenderer::bin(const TriangleSetup &setup) {
+    auto index = (unsigned int) triangles.size();
+    triangles.push_back(BinnedTriangle{setup, raster_func, visibility_func, program.shade, program.uniforms,
+                                       program.discards});
+    for (int ty = setup.min_y / TILE_SIZE; ty <= (setup.max_y - 1) / TILE_SIZE; ty++) {
+        for (int tx = setup.min_x / TILE_SIZE; tx <= (setup.max_x - 1) / TILE_SIZE; tx++) {
+            bins[ty * tiles_x + tx].push_back(index);
+        }
+    }
+}
+
+void TileRenderer::project_vertices() {
+    clip_codes.resize(clip_vertices.size() * VERTEX_BATCH);
+    screen_vertices.resize(clip_vertices.size());
+    // a batch at a time, lanes that go on to be clipped are projected all the same.
+    for (size_t i = 0; i < clip_vertices.size(); i++) {
+        batch_outcodes(clip_vertices[i], guard_x, guard_y, &clip_codes[i * VERTEX_BATCH]);
+        if (homogeneous) {
+            batch_homogeneous_screen_transform(clip_vertices[i], screen_vertices[i], (float) width, (float) height);
+        } else {
+            batch_screen_transform(clip_vertices[i], screen_vertices[i], (float) width, (float) height);
+        }
+    }
+}
+
+void TileRenderer::draw_triangles(const unsigned int indices[], int n) {
+    // the triangles needing no clipping are culled together, by their screen space positions.
+    alignas(32) float x[3][SETUP_BATCH] = {}, y[3][SETUP_BATCH] = {};
+    bool direct[SETUP_BATCH];
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        const unsigned int *triangle = indices + 3 * i;
+        unsigned int codes[3] = {clip_codes[triangle[0]], clip_codes[triangle[1]], clip_codes[triangle[2]]};
+        unsigned int crossed = codes[0] | codes[1] | codes[2];
+        direct[i] = !homogeneous && !(codes[0] & codes[1] & codes[2] & CLIP_VIEW) &&
+                    !(crossed & (CLIP_NEAR | CLIP_FAR | CLIP_GUARD));
+        if (!direct[i]) continue;
+        for (int k = 0; k < 3; k++) {
+            const VertexBatch &batch = screen_vertices[triangle[k] / VERTEX_BATCH];
+            x[k][count] = batch.x[triangle[k] % VERTEX_BATCH];
+            y[k][count] = batch.y[triangle[k] % VERTEX_BATCH];
+        }
+        count++;
+    }
+    unsigned int culled[SETUP_BATCH];
+    triangle_cull(setup_func, x, y, count, scissor, windings, culled);
+
+    int lane = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned int a = indices[3 * i], b = indices[3 * i + 1], c = indices[3 * i + 2];
+        if (!direct[i]) {
+            draw_clipped(a, b, c);
+            continue;
+        }
+        // the scissor takes care of the sides of the viewport. clockwise ones are queued the
+        // other way around, both ways when the cull stage leaves it to the setup.
+        unsigned int wound = culled[lane];
+        if (wound & WINDING_CCW) queue_triangle(a, b, c, x, y, lane, false);
+        if (wound & WINDING_CW) queue_triangle(a, b, c, x, y, lane, true);
+        lane++;
+    }
+}
+
+void TileRenderer::queue_triangle(unsigned int a, unsigned int b, unsigned int c, const float x[3][SETUP_BATCH],
+                                  const float y[3][SETUP_BATCH], int lane, bool reversed) {
+    unsigned int *triangle = batch_indices + 3 * batch_count;
+    triangle[0] = a;
+    triangle[1] = reversed ? c : b;
+    triangle[2] = reversed ? b : c;
+    for (int k = 0; k < 3; k++) {
+        int from = reversed ? (3 - k) % 3 : k;
+        batch_x[k][batch_count] = x[from][lane];
+        batch_y[k][batch_count] = y[from][lane];
+    }
+    if (++batch_count == SETUP_BATCH) setup_batch();
+}
+
+void TileRenderer::draw_clipped(unsigned int a, unsigned int b, unsigned int c) {
+    unsigned int codes[3] = {clip_codes[a], clip_codes[b], clip_codes[c]};
+    if (codes[0] & codes[1] & codes[2] & CLIP_VIEW) return;
+    setup_batch();
+    if (homogeneous) {
+        Vertex triangle[3] = {stream_vertex(screen_vertices, a), stream_vertex(screen_vertices, b),
+                              stream_vertex(screen_vertices, c)};
+        TriangleSetup setup{};
+        if (setup_wound(triangle_setup_homogeneous, triangle, windings, scissor, setup)) bin(setup);
+        return;
+    }
+    unsigned int crossed = codes[0] | codes[1] | codes[2];
+    // past the guard band the sides have to be clipped to as well, inside it near / far only.
+    unsigned int planes = crossed & CLIP_GUARD ? CLIP_VIEW : CLIP_NEAR | CLIP_FAR;
+    for (auto &code: codes) code &= planes;
+    unsigned int triangle[3] = {a, b, c};
+    ClipPolygon polygon;
+    int n = triangle_clip(clip_vertices, triangle, codes, polygon);
+    polygon_screen_transform(polygon, n, (float) width, (float) height);
+    // straight from the polygon into setup, as a fan. the clipped polygon winds as the triangle
+    // did, clockwise ones are set up from the polygon the other way around.
+    TriangleSetup setups[FAN_MAX_VERTICES - 2];
+    int count = 0;
+    if (windings & WINDING_CCW) count = triangle_fan_setup(setup_func, polygon, n, false, scissor, setups);
+    if (count == 0 && (windings & WINDING_CW)) {
+        count = triangle_fan_setup(setup_func, polygon, n, true, scissor, setups);
+    }
+    for (int i = 0; i < count; i++) bin(setups[i]);
+}
+
+void TileRenderer::setup_batch() {
+    TriangleSetup setups[SETUP_BATCH];
+    int count = triangle_setup_batch(setup_func, screen_vertices, batch_indices, batch_x, batch_y, batch_count,
+                                     scissor, setups);
+    for (int i = 0; i < count; i++) bin(setups[i]);
+    batch_count = 0;
+}
+
+void TileRenderer::clear(unsigned int color, unsigned short depth) {
+    bool same = color == clear_color && depth == clear_depth;
+    for (auto &state: tile_state) {
+        if (state != TILE_CLEAR || !same) state = TILE_CLEAR_PENDING;
+    }
+    clear_color = color;
+    clear_depth = depth;
+}
+
+void TileRenderer::set_layout(SurfaceLayout _layout) {
+    layout = _layout;
+}
+
+void TileRenderer::set_depth_planes(DepthPlanes *_planes) {
+    planes = _planes;
+}
+
+void TileRenderer::set_target(const RenderTarget &next) {
+    // the tiles holding the clear values hold them in the old buffers, layout and planes only.
+    if (next.fb != target.fb || next.db != target.db || next.layout != target.layout ||
+        next.planes != target.planes) {
+        for (auto &state: tile_state) {
+            if (state == TILE_CLEAR) state = TILE_CLEAR_PENDING;
+        }
+    }
+    target = next;
+}
+
+void TileRenderer::resolve(unsigned short *db, unsigned int *fb, HiZBuffer *hiz) {
+    set_target(RenderTarget{fb, db, surface_stride(width, layout), hiz, layout, planes});
+    for (unsigned int tile = 0; tile < tiles_x * tiles_y; tile++) {
+        if (tile_state[tile] == TILE_CLEAR_PENDING) {
+            clear_tile(tile_rect(tile));
+            tile_state[tile] = TILE_CLEAR;
+        } else if (tile_state[tile] == TILE_CLEAR && hiz) {
+            hiz->clear(tile_rect(tile), clear_depth);
+        }
+    }
+}
+
+void TileRenderer::flush(const Texture *_tex, unsigned short *db, unsigned int *fb, HiZBuffer *hiz) {
+    flush_visibility(_tex, db, nullptr, fb, hiz);
+}
+
+void TileRenderer::flush_visibility(const Texture *_tex, unsigned short *db, unsigned int *_vb, unsigned int *fb,
+                                    HiZBuffer *hiz) {
+    tex = _tex;
+    set_target(RenderTarget{fb, db, surface_stride(width, layout), hiz, layout, planes});
+    vb = _vb;
+    next_tile = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        busy = (unsigned int) workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    run_tiles();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return busy == 0; });
+    }
+
+    triangles.clear();
+    for (auto &bin: bins) bin.clear();
+}
+
+void TileRenderer::worker_main() {
+    unsigned int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+        run_tiles();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            busy--;
+        }
+        done.notify_one();
+    }
+}
+
+void TileRenderer::run_tiles() {
+    unsigned int tile_cnt = tiles_x * tiles_y;
+    for (unsigned int tile = next_tile++; tile < tile_cnt; tile = next_tile++) {
+        raster_tile(tile);
+    }
+}
+
+Rect TileRenderer::tile_rect(unsigned int tile) const {
+    int tx = (int) (tile % tiles_x) * TILE_SIZE;
+    int ty = (int) (tile / tiles_x) * TILE_SIZE;
+    return Rect{tx, ty, std::min(tx + TILE_SIZE, (int) width), std::min(ty + TILE_SIZE, (int) height)};
+}
+
+// end of the run of row pixels from x on that are consecutive in memory.
+static inline int span_end(const RenderTarget &target, int x, int max_x) {
+    if (target.layout == SURFACE_LINEAR) return max_x;
+    return std::min((x & ~(BLOCK_SIZE - 1)) + BLOCK_SIZE, max_x);
+}
+
+template<class T>
+static void fill_rect(T *surface, const RenderTarget &target, const Rect &rect, T value) {
+    for (int y = rect.min_y; y < rect.max_y; y++) {
+        for (int x = rect.min_x, x1; x < rect.max_x; x = x1) {
+            x1 = span_end(target, x, rect.max_x);
+            T *row = pixel_row(surface, target.layout, target.stride, x, y);
+            std::fill(row + x, row + x1, value);
+        }
+    }
+}
+
+void TileRenderer::clear_tile(const Rect &rect) {
+    fill_rect(target.fb, target, rect, clear_color);
+    if (target.planes) target.planes->clear(rect, clear_depth);
+    else fill_rect(target.db, target, rect, clear_depth);
+    if (target.hiz) target.hiz->clear(rect, clear_depth);
+}
+
+void TileRenderer::raster_tile(unsigned int tile) {
+    const auto &bin = bins[tile];
+    if (bin.empty()) return;
+    Rect rect = tile_rect(tile);
+    // first touch since a clear.
+    if (tile_state[tile] == TILE_CLEAR_PENDING) clear_tile(rect);
+    else if (tile_state[tile] == TILE_CLEAR && target.hiz) target.hiz->clear(rect, clear_depth);
+    tile_state[tile] = TILE_DRAWN;
+    if (!vb) {
+        for (unsigned int index: bin) {
+            const BinnedTriangle &triangle = triangles[index];
+            triangle.raster(triangle.setup, rect, target, triangle.uniforms ? triangle.uniforms : tex);
+        }
+        return;
+    }
+
+    // id 0 is no triangle, the pixel keeps its colour.
+    fill_rect(vb, target, rect, 0u);
+    RenderTarget ids{vb, target.db, target.stride, target.hiz, target.layout, target.planes};
+    // whether vb holds ids not shaded yet.
+    bool visible = false;
+    for (unsigned int index: bin) {
+        const BinnedTriangle &triangle = triangles[index];
+        if (!triangle.discards) {
+            triangle.visibility(triangle.setup, rect, ids, index + 1);
+            visible = true;
+            continue;
+        }
+        // which pixels a discarding triangle covers is up to its shader: shade the ones visible
+        // so far, then draw it as flush() does.
+        if (visible) {
+            shade_tile(rect);
+            fill_rect(vb, target, rect, 0u);
+            visible = false;
+        }
+        triangle.raster(triangle.setup, rect, target, triangle.uniforms ? triangle.uniforms : tex);
+    }
+    if (visible) shade_tile(rect);
+}
+
+void TileRenderer::shade_tile(const Rect &rect) {
+    for (int y = rect.min_y; y < rect.max_y; y++) {
+        // runs of pixels showing the same triangle.
+        for (int x = rect.min_x, x1; x < rect.max_x; x = x1) {
+            int end = span_end(target, x, rect.max_x);
+            const unsigned int *ids = pixel_row(vb, target.layout, target.stride, x, y);
+            unsigned int *fb = pixel_row(target.fb, target.layout, target.stride, x, y);
+            unsigned int id = ids[x];
+            for (x1 = x + 1; x1 < end && ids[x1] == id; x1++);
+            if (id == 0) continue;
+            const BinnedTriangle &triangle = triangles[id - 1];
+            triangle.shade(triangle.setup, x, y, x1 - x, triangle.uniforms ? triangle.uniforms : tex, fb + x);
+        }
+    }
+}
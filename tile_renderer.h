@@ -0,0 +1,225 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_TILE_RENDERER_H
+#define SIMPLE_SOFT_RASTERIZER_TILE_RENDERER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "rasterizer.h"
+#include "vertex_stage.h"
+
+// sort-middle renderer: draw() sets up triangles and bins them into screen tiles,
+// flush() lets a pool of workers rasterize whole tiles. a tile is only ever touched
+// by one thread, and sees its triangles in submission order, so the output matches
+// half_space_rasterizer pixel for pixel.
+class TileRenderer {
+public:
+    static constexpr int TILE_SIZE = 64;
+
+    // threads == 0 picks std::thread::hardware_concurrency().
+    TileRenderer(unsigned int width, unsigned int height, unsigned int threads = 0);
+
+    ~TileRenderer();
+
+    TileRenderer(const TileRenderer &) = delete;
+
+    TileRenderer &operator=(const TileRenderer &) = delete;
+
+    // later draws only touch pixels inside scissor, until the next call.
+    void set_scissor(const Rect &scissor);
+
+    // fixed-point format later draws are set up in, e.g. triangle_setup<12, 4>, and the screen
+    // space range it takes, e.g. setup_range<12, 4>(). draw_indexed() only clips triangles
+    // crossing the sides of the viewport when they reach outside of that range, 0 for always.
+    void set_setup(TriangleSetupFunc setup, float range = 0.f);
+
+    // layout of the fb / db (and vb) of later flushes and resolves. tiled surfaces are
+    // surface_stride(width, SURFACE_TILED) pixels wide, see surface.h.
+    void set_layout(SurfaceLayout layout);
+
+    // keep the depth of later flushes and resolves compressed in planes, or not with nullptr.
+    // db then only holds the blocks planes keeps raw, planes->decompress() fills in the rest.
+    void set_depth_planes(DepthPlanes *planes);
+
+    // whether later draw_indexed() calls rasterize in homogeneous coordinates, with
+    // triangle_setup_homogeneous(), instead of clipping and projecting their triangles.
+    void set_homogeneous(bool homogeneous);
+
+    // pipeline state of later draws.
+    void set_state(const RasterState &state);
+
+    // fragment shader of later draws, e.g. fragment_program<MyShader>(&uniforms). draws without
+    // uniforms are shaded with the tex of their flush, the default being TextureShader.
+    void set_program(const FragmentProgram &program);
+
+    // input here should be in screen space. it is culled as the state says.
+    void draw(const Vertex input[3]);
+
+    // input here is a mesh: vertices[0, vertex_count) go through the vertex shader once each
+    // (see vertex_stage.h), then every three indices (16 or 32 bit) make a clip space triangle that
+    // is clipped to the view volume, projected to the viewport and drawn. vertices inside the near / far
+    // planes and the guard band (see set_setup()) are projected once too, triangles of only those
+    // are drawn without clipping, leaving the sides of the viewport to the scissor, and culled
+    // (see triangle_cull()) and set up SETUP_BATCH at a time. see also set_homogeneous().
+    template<class Index, class Shader>
+    void draw_indexed(const Vertex *vertices, unsigned int vertex_count, const Index *indices,
+                      unsigned int index_count, const Shader &shader) {
+        stream_load(clip_vertices, vertices, (int) vertex_count);
+        vertex_stage(clip_vertices, clip_vertices, shader);
+        draw_stream(indices, index_count);
+    }
+
+    // same, with a mesh kept as a vertex stream, which goes into the vertex shader as it is.
+    template<class Index, class Shader>
+    void draw_indexed(const VertexStream &vertices, const Index *indices, unsigned int index_count,
+                      const Shader &shader) {
+        vertex_stage(vertices, clip_vertices, shader);
+        draw_stream(indices, index_count);
+    }
+
+    // fast clear: every tile counts as filled with color / depth, but is only written on its
+    // first flush after this, or by resolve(). tiles that already hold these values in the
+    // buffers, layout and planes of the next flush or resolve are not written again.
+    void clear(unsigned int color, unsigned short depth);
+
+    // write the clear values into the tiles no flush touched since clear(). call before fb / db
+    // are read.
+    void resolve(unsigned short *db, unsigned int *fb, HiZBuffer *hiz = nullptr);
+
+    // rasterize everything drawn since the last flush into db / fb, hiz (optional) has to
+    // describe db and is kept up to date.
+    void flush(const Texture *tex, unsigned short *db, unsigned int *fb, HiZBuffer *hiz = nullptr);
+
+    // same result for opaque draws (blending is ignored), but each tile first rasterizes depth
+    // and the id of the visible triangle into vb, then shades every covered pixel exactly once.
+    // vb is scratch space the size of fb. triangles of a discarding program are drawn as flush()
+    // does, in order with the others.
+    void flush_visibility(const Texture *tex, unsigned short *db, unsigned int *vb, unsigned int *fb,
+                          HiZBuffer *hiz = nullptr);
+
+private:
+    void worker_main();
+
+    void run_tiles();
+
+    void shade_tile(const Rect &rect);
+
+    Rect tile_rect(unsigned int tile) const;
+
+    void clear_tile(const Rect &rect);
+
+    void raster_tile(unsigned int tile);
+
+    // make next the target of a flush or resolve.
+    void set_target(const RenderTarget &next);
+
+    // queue a triangle set up against scissor into the tiles it touches.
+    void bin(const TriangleSetup &setup);
+
+    // the triangles of indices over clip_vertices.
+    template<class Index>
+    void draw_stream(const Index *indices, unsigned int index_count) {
+        static_assert(std::is_same<Index, unsigned short>::value || std::is_same<Index, unsigned int>::value,
+                      "16 or 32 bit indices");
+        project_vertices();
+        unsigned int triangle_indices[SETUP_BATCH * 3];
+        for (unsigned int i = 0; i + 2 < index_count; i += SETUP_BATCH * 3) {
+            unsigned int left = (index_count - i) / 3;
+            int n = left < SETUP_BATCH ? (int) left : SETUP_BATCH;
+            for (int j = 0; j < n * 3; j++) triangle_indices[j] = indices[i + j];
+            draw_triangles(triangle_indices, n);
+        }
+        setup_batch();
+    }
+
+    // fill clip_codes and screen_vertices, in homogeneous screen space when homogeneous. only
+    // the vertices needing no clipping are used from the latter.
+    void project_vertices();
+
+    // the n (up to SETUP_BATCH) triangles of indices[0, 3 * n) over clip_vertices, in order. the
+    // ones needing no clipping go through triangle_cull() together and are queued in the batch.
+    void draw_triangles(const unsigned int indices[], int n);
+
+    // triangle (a, b, c) of clip_vertices, one draw_triangles() leaves to be clipped or set up
+    // homogeneous.
+    void draw_clipped(unsigned int a, unsigned int b, unsigned int c);
+
+    // triangle (a, b, c) of screen_vertices into the batch, lane of x / y holding its positions as
+    // draw_triangles() gathered them. reversed queues it as (a, c, b).
+    void queue_triangle(unsigned int a, unsigned int b, unsigned int c, const float x[3][SETUP_BATCH],
+                        const float y[3][SETUP_BATCH], int lane, bool reversed);
+
+    // set up and bin the triangles of the batch, see triangle_setup_batch().
+    void setup_batch();
+
+    unsigned int width, height;
+    unsigned int tiles_x, tiles_y;
+    // already clipped to the screen.
+    Rect scissor;
+    TriangleSetupFunc setup_func = triangle_setup;
+    // guard band of setup_func in clip space, see clip_outcode().
+    float guard_x = 1.f, guard_y = 1.f;
+    bool homogeneous = false;
+    RasterState state{};
+    // the windings state draws, see triangle_cull().
+    unsigned int windings = WINDING_CCW;
+    FragmentProgram program{select_raster, shade_span, nullptr, false};
+    RasterFunc raster_func = triangle_raster;
+    SurfaceLayout layout = SURFACE_LINEAR;
+    DepthPlanes *planes = nullptr;
+    VisibilityFunc visibility_func = select_visibility(RasterState{});
+
+    struct BinnedTriangle {
+        TriangleSetup setup;
+        RasterFunc raster;
+        VisibilityFunc visibility;
+        ShadeFunc shade;
+        const void *uniforms;
+        // drawn with raster in a visibility flush too.
+        bool discards;
+    };
+    std::vector<BinnedTriangle> triangles;
+    // vertex shader output of the current draw_indexed(), its clip_outcode()s and its screen
+    // space position.
+    VertexStream clip_vertices;
+    std::vector<unsigned int> clip_codes;
+    VertexStream screen_vertices;
+    // screen space triangles of it that need no clipping, waiting to be set up together: their
+    // indices and, lane by lane, their positions. they are binned before any later triangle, which
+    // keeps the submission order.
+    unsigned int batch_indices[SETUP_BATCH * 3];
+    alignas(32) float batch_x[3][SETUP_BATCH] = {}, batch_y[3][SETUP_BATCH] = {};
+    int batch_count = 0;
+    std::vector<std::vector<unsigned int>> bins;
+
+    enum TileState : unsigned char {
+        // what the buffers hold is up to the draws.
+        TILE_DRAWN,
+        // counts as cleared, the buffers are not yet.
+        TILE_CLEAR_PENDING,
+        // the buffers of target hold the clear values.
+        TILE_CLEAR
+    };
+    std::vector<TileState> tile_state;
+    unsigned int clear_color = 0;
+    unsigned short clear_depth = 0;
+
+    // state of the current flush, read by the workers.
+    const Texture *tex = nullptr;
+    RenderTarget target{};
+    // the visibility buffer of a flush_visibility, or nullptr.
+    unsigned int *vb = nullptr;
+    std::atomic<unsigned int> next_tile{0};
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    unsigned int generation = 0;
+    unsigned int busy = 0;
+    bool quit = false;
+};
+
+#endif //SIMPLE_SOFT_RASTERIZER_TILE_RENDERER_H
@@ -5,6 +5,8 @@
 #ifndef SIMPLE_SOFT_RASTERIZER_VERTEX_H
 #define SIMPLE_SOFT_RASTERIZER_VERTEX_H
 
+#include <type_traits>
+
 #include <glm/glm.hpp>
 
 class Vertex {
@@ -14,8 +16,6 @@ public:
 
     Vertex() = default;
 
-    ~Vertex() = default;
-
     Vertex(
             const glm::vec4 &_pos,
             const glm::vec2 &_tex
@@ -27,8 +27,9 @@ public:
             const glm::vec2 &_tex = glm::vec2(0, 0)
     ) :
             position(_pos, 1.0f), texcoord(_tex) {}
-
-    Vertex(const Vertex &v) : position(v.position), texcoord(v.texcoord) {}
 };
 
+// copies are plain moves of its 24 bytes.
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex is trivially copyable");
+
 #endif //SIMPLE_SOFT_RASTERIZER_VERTEX_H
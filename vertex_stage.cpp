@@ -0,0 +1,100 @@
+#include "vertex_stage.h"
+#include "rasterizer.h"
+
+void transform_vertices(const glm::mat4 &matrix, const Vertex *in, Vertex *out, int n) {
+    vertex_stage(in, out, n, TransformShader{matrix});
+}
+
+void stream_load(VertexStream &stream, const Vertex *in, int n) {
+    stream.resize(stream_batches(n));
+    for (int i = 0; i < n; i += VERTEX_BATCH) {
+        batch_load(stream[i / VERTEX_BATCH], in + i, n - i < VERTEX_BATCH ? n - i : VERTEX_BATCH);
+    }
+}
+
+void batch_outcodes(const VertexBatch &batch, float guard_x, float guard_y, unsigned int codes[VERTEX_BATCH]) {
+    int i = 0;
+#if defined(__SSE2__)
+    // the not-compares are true for NaN as well, like the negated ones of clip_outcode().
+    for (; i < VERTEX_BATCH; i += 4) {
+        __m128 x = _mm_load_ps(batch.x + i), y = _mm_load_ps(batch.y + i);
+        __m128 z = _mm_load_ps(batch.z + i), w = _mm_load_ps(batch.w + i);
+        __m128 minus_w = _mm_sub_ps(_mm_setzero_ps(), w);
+        __m128 gx = _mm_mul_ps(_mm_set1_ps(guard_x), w), gy = _mm_mul_ps(_mm_set1_ps(guard_y), w);
+        __m128 minus_gx = _mm_mul_ps(_mm_set1_ps(-guard_x), w), minus_gy = _mm_mul_ps(_mm_set1_ps(-guard_y), w);
+        __m128 out[10] = {_mm_cmpnge_ps(z, minus_w), _mm_cmpnle_ps(z, w),
+                          _mm_cmpnge_ps(x, minus_w), _mm_cmpnle_ps(x, w),
+                          _mm_cmpnle_ps(y, w), _mm_cmpnge_ps(y, minus_w),
+                          _mm_cmpnge_ps(x, minus_gx), _mm_cmpnle_ps(x, gx),
+                          _mm_cmpnle_ps(y, gy), _mm_cmpnge_ps(y, minus_gy)};
+        __m128i code = _mm_setzero_si128();
+        for (int k = 0; k < 10; k++) {
+            code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(out[k]), _mm_set1_epi32(1 << k)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(codes + i), code);
+    }
+#endif
+    for (; i < VERTEX_BATCH; i++) {
+        codes[i] = clip_outcode(glm::vec4(batch.x[i], batch.y[i], batch.z[i], batch.w[i]), guard_x, guard_y);
+    }
+}
+
+void batch_screen_transform(const VertexBatch &batch, VertexBatch &out, float width, float height) {
+    int i = 0;
+#if defined(__SSE2__)
+    // the same operations in the same order as the scalar ones, so the same results.
+    const __m128 two = _mm_set1_ps(2.f), one = _mm_set1_ps(1.f);
+    const __m128 vw = _mm_set1_ps(width), vh = _mm_set1_ps(height);
+    for (; i < VERTEX_BATCH; i += 4) {
+        __m128 w = _mm_load_ps(batch.w + i);
+        __m128 x = _mm_div_ps(_mm_load_ps(batch.x + i), w);
+        __m128 y = _mm_div_ps(_mm_load_ps(batch.y + i), w);
+        __m128 z = _mm_div_ps(_mm_load_ps(batch.z + i), w);
+        _mm_store_ps(out.x + i, _mm_div_ps(_mm_add_ps(_mm_mul_ps(x, vw), vw), two));
+        _mm_store_ps(out.y + i, _mm_div_ps(_mm_add_ps(_mm_mul_ps(y, vh), vh), two));
+        _mm_store_ps(out.z + i, _mm_div_ps(_mm_sub_ps(one, z), two));
+        _mm_store_ps(out.w + i, w);
+        _mm_store_ps(out.u + i, _mm_load_ps(batch.u + i));
+        _mm_store_ps(out.v + i, _mm_load_ps(batch.v + i));
+    }
+#endif
+    for (; i < VERTEX_BATCH; i++) {
+        Vertex vertex(glm::vec4(batch.x[i], batch.y[i], batch.z[i], batch.w[i]), glm::vec2(batch.u[i], batch.v[i]));
+        perspective_division(vertex, vertex);
+        screen_transform(vertex, vertex, width, height);
+        out.x[i] = vertex.position.x;
+        out.y[i] = vertex.position.y;
+        out.z[i] = vertex.position.z;
+        out.w[i] = vertex.position.w;
+        out.u[i] = vertex.texcoord.x;
+        out.v[i] = vertex.texcoord.y;
+    }
+}
+
+void batch_homogeneous_screen_transform(const VertexBatch &batch, VertexBatch &out, float width, float height) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 vw = _mm_set1_ps(width), vh = _mm_set1_ps(height);
+    for (; i < VERTEX_BATCH; i += 4) {
+        __m128 w = _mm_load_ps(batch.w + i);
+        __m128 x = _mm_load_ps(batch.x + i), y = _mm_load_ps(batch.y + i), z = _mm_load_ps(batch.z + i);
+        _mm_store_ps(out.x + i, _mm_div_ps(_mm_mul_ps(_mm_add_ps(x, w), vw), two));
+        _mm_store_ps(out.y + i, _mm_div_ps(_mm_mul_ps(_mm_add_ps(y, w), vh), two));
+        _mm_store_ps(out.z + i, _mm_div_ps(_mm_sub_ps(w, z), two));
+        _mm_store_ps(out.w + i, w);
+        _mm_store_ps(out.u + i, _mm_load_ps(batch.u + i));
+        _mm_store_ps(out.v + i, _mm_load_ps(batch.v + i));
+    }
+#endif
+    for (; i < VERTEX_BATCH; i++) {
+        Vertex vertex(glm::vec4(batch.x[i], batch.y[i], batch.z[i], batch.w[i]), glm::vec2(batch.u[i], batch.v[i]));
+        homogeneous_screen_transform(vertex, vertex, width, height);
+        out.x[i] = vertex.position.x;
+        out.y[i] = vertex.position.y;
+        out.z[i] = vertex.position.z;
+        out.w[i] = vertex.position.w;
+        out.u[i] = vertex.texcoord.x;
+        out.v[i] = vertex.texcoord.y;
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef SIMPLE_SOFT_RASTERIZER_VERTEX_STAGE_H
+#define SIMPLE_SOFT_RASTERIZER_VERTEX_STAGE_H
+
+#include <vector>
+
+#include "vertex.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// vertices go through the vertex stage VERTEX_BATCH at a time.
+static const int VERTEX_BATCH = 8;
+
+// a batch of vertices as structure of arrays, lane i of every array is vertex i. every array is
+// 32 byte aligned, so a shader can load it straight into a register.
+struct VertexBatch {
+    alignas(32) float x[VERTEX_BATCH];
+    alignas(32) float y[VERTEX_BATCH];
+    alignas(32) float z[VERTEX_BATCH];
+    alignas(32) float w[VERTEX_BATCH];
+    alignas(32) float u[VERTEX_BATCH];
+    alignas(32) float v[VERTEX_BATCH];
+};
+
+// a vertex shader is a class vertex_stage() is compiled for, called once per batch:
+//
+//   struct MyVertexShader {
+//       // on entry the batch holds the input vertices, on return their clip space positions and
+//       // texcoords. lanes past the end of the input hold padding and are not stored.
+//       void shade(VertexBatch &batch) const;
+//   };
+//
+// batch_transform() does the usual matrix part with SIMD, see TransformShader. the outputs are
+// the position and the one texcoord pair, the only attributes the setups interpolate: there are
+// no lanes for extra varyings.
+
+// (x, y, z, w) = matrix * (x, y, z, w) in every lane, rounded as glm's own matrix * vector.
+static inline void batch_transform(const glm::mat4 &matrix, VertexBatch &batch) {
+    const glm::mat4 &m = matrix;
+#if defined(__AVX2__)
+    for (int i = 0; i < VERTEX_BATCH; i += 8) {
+        __m256 x = _mm256_load_ps(batch.x + i), y = _mm256_load_ps(batch.y + i);
+        __m256 z = _mm256_load_ps(batch.z + i), w = _mm256_load_ps(batch.w + i);
+        float *out[4] = {batch.x + i, batch.y + i, batch.z + i, batch.w + i};
+        for (int r = 0; r < 4; r++) {
+            __m256 a = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][r]), x), _mm256_mul_ps(_mm256_set1_ps(m[1][r]), y));
+            __m256 b = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2][r]), z), _mm256_mul_ps(_mm256_set1_ps(m[3][r]), w));
+            _mm256_store_ps(out[r], _mm256_add_ps(a, b));
+        }
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < VERTEX_BATCH; i += 4) {
+        __m128 x = _mm_load_ps(batch.x + i), y = _mm_load_ps(batch.y + i);
+        __m128 z = _mm_load_ps(batch.z + i), w = _mm_load_ps(batch.w + i);
+        float *out[4] = {batch.x + i, batch.y + i, batch.z + i, batch.w + i};
+        for (int r = 0; r < 4; r++) {
+            __m128 a = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][r]), x), _mm_mul_ps(_mm_set1_ps(m[1][r]), y));
+            __m128 b = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][r]), z), _mm_mul_ps(_mm_set1_ps(m[3][r]), w));
+            _mm_store_ps(out[r], _mm_add_ps(a, b));
+        }
+    }
+#else
+    for (int i = 0; i < VERTEX_BATCH; i++) {
+        glm::vec4 p = m * glm::vec4(batch.x[i], batch.y[i], batch.z[i], batch.w[i]);
+        batch.x[i] = p.x;
+        batch.y[i] = p.y;
+        batch.z[i] = p.z;
+        batch.w[i] = p.w;
+    }
+#endif
+}
+
+// in[0, n) into the first n lanes of batch, the rest is padded with (0, 0, 0, 1).
+static inline void batch_load(VertexBatch &batch, const Vertex *in, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    // transpose the positions 4 vertices at a time.
+    for (; i + 4 <= n; i += 4) {
+        __m128 p0 = _mm_loadu_ps(&in[i].position.x), p1 = _mm_loadu_ps(&in[i + 1].position.x);
+        __m128 p2 = _mm_loadu_ps(&in[i + 2].position.x), p3 = _mm_loadu_ps(&in[i + 3].position.x);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_store_ps(batch.x + i, p0);
+        _mm_store_ps(batch.y + i, p1);
+        _mm_store_ps(batch.z + i, p2);
+        _mm_store_ps(batch.w + i, p3);
+    }
+#endif
+    for (; i < n; i++) {
+        batch.x[i] = in[i].position.x;
+        batch.y[i] = in[i].position.y;
+        batch.z[i] = in[i].position.z;
+        batch.w[i] = in[i].position.w;
+    }
+    for (; i < VERTEX_BATCH; i++) {
+        batch.x[i] = batch.y[i] = batch.z[i] = 0.f;
+        batch.w[i] = 1.f;
+        batch.u[i] = batch.v[i] = 0.f;
+    }
+    for (i = 0; i < n; i++) {
+        batch.u[i] = in[i].texcoord.x;
+        batch.v[i] = in[i].texcoord.y;
+    }
+}
+
+// the first n lanes of batch into out[0, n).
+static inline void batch_store(const VertexBatch &batch, Vertex *out, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 p0 = _mm_load_ps(batch.x + i), p1 = _mm_load_ps(batch.y + i);
+        __m128 p2 = _mm_load_ps(batch.z + i), p3 = _mm_load_ps(batch.w + i);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(&out[i].position.x, p0);
+        _mm_storeu_ps(&out[i + 1].position.x, p1);
+        _mm_storeu_ps(&out[i + 2].position.x, p2);
+        _mm_storeu_ps(&out[i + 3].position.x, p3);
+    }
+#endif
+    for (; i < n; i++) out[i].position = glm::vec4(batch.x[i], batch.y[i], batch.z[i], batch.w[i]);
+    for (i = 0; i < n; i++) out[i].texcoord = glm::vec2(batch.u[i], batch.v[i]);
+}
+
+// the fixed function transform: position = matrix * position, texcoord passes through.
+struct TransformShader {
+    void shade(VertexBatch &batch) const {
+        batch_transform(matrix, batch);
+    }
+
+    glm::mat4 matrix;
+};
+
+// a vertex stream: vertices as structure of arrays, vertex i being lane i % VERTEX_BATCH of
+// batch i / VERTEX_BATCH. the last batch is padded the way batch_load() pads, so every stage
+// works on whole batches.
+using VertexStream = std::vector<VertexBatch>;
+
+inline int stream_batches(int n) {
+    return (n + VERTEX_BATCH - 1) / VERTEX_BATCH;
+}
+
+// in[0, n) into stream.
+void stream_load(VertexStream &stream, const Vertex *in, int n);
+
+// vertex i of stream.
+inline Vertex stream_vertex(const VertexStream &stream, unsigned int i) {
+    const VertexBatch &batch = stream[i / VERTEX_BATCH];
+    unsigned int j = i % VERTEX_BATCH;
+    return Vertex(glm::vec4(batch.x[j], batch.y[j], batch.z[j], batch.w[j]), glm::vec2(batch.u[j], batch.v[j]));
+}
+
+// clip_outcode(p, guard_x, guard_y) of every lane of batch.
+void batch_outcodes(const VertexBatch &batch, float guard_x, float guard_y, unsigned int codes[VERTEX_BATCH]);
+
+// perspective_division() and screen_transform() of every lane of batch into out, which may be batch.
+void batch_screen_transform(const VertexBatch &batch, VertexBatch &out, float width, float height);
+
+// homogeneous_screen_transform() of every lane of batch into out, which may be batch.
+void batch_homogeneous_screen_transform(const VertexBatch &batch, VertexBatch &out, float width, float height);
+
+// run in[0, n) through shader into out[0, n), in and out may be the same array.
+template<class Shader>
+void vertex_stage(const Vertex *in, Vertex *out, int n, const Shader &shader) {
+    VertexBatch batch;
+    for (int i = 0; i < n; i += VERTEX_BATCH) {
+        int m = n - i < VERTEX_BATCH ? n - i : VERTEX_BATCH;
+        batch_load(batch, in + i, m);
+        shader.shade(batch);
+        batch_store(batch, out + i, m);
+    }
+}
+
+// the stream in through shader into out, which may be in.
+template<class Shader>
+void vertex_stage(const VertexStream &in, VertexStream &out, const Shader &shader) {
+    out.resize(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        out[i] = in[i];
+        shader.shade(out[i]);
+    }
+}
+
+// vertex_stage() with TransformShader{matrix}.
+void transform_vertices(const glm::mat4 &matrix, const Vertex *in, Vertex *out, int n);
+
+#endif //SIMPLE_SOFT_RASTERIZER_VERTEX_STAGE_H